@@ -70,6 +70,25 @@ Test_MNAlgorithm_v1_4AudioProcessorEditor::Test_MNAlgorithm_v1_4AudioProcessorEd
     osLabel.setText("Oversampling", juce::dontSendNotification);
     osLabel.setJustificationType(juce::Justification::centredTop);
 
+    //======================Quality Level==================================
+    addAndMakeVisible(qualityLabel);
+    qualityLabel.setJustificationType(juce::Justification::centredRight);
+    qualityLabel.setText(audioProcessor.getQualityDescription(), juce::dontSendNotification);
+    startTimerHz(4);
+
+    //======================Potentiometer Dials==================================
+    for (int i = 0; i < Netlist::numKnobs; ++i) {
+        addAndMakeVisible(potSliders[i]);
+        potSliders[i].setSliderStyle(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag);
+        potSliders[i].setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
+        potAttachements[i].reset(new juce::AudioProcessorValueTreeState::SliderAttachment(vts, "pot " + juce::String(i + 1), potSliders[i]));
+
+        addAndMakeVisible(potLabels[i]);
+        potLabels[i].attachToComponent(&potSliders[i], false);
+        potLabels[i].setText("P" + juce::String(i + 1), juce::dontSendNotification);
+        potLabels[i].setJustificationType(juce::Justification::centredBottom);
+    }
+
     //======================OpenFile Button==================================
     
     
@@ -105,7 +124,28 @@ Test_MNAlgorithm_v1_4AudioProcessorEditor::Test_MNAlgorithm_v1_4AudioProcessorEd
     updateButton.setButtonText("Update");
     updateButton.onClick = [this] { updateButtonClicked(); };
 
-    setSize(600, 500);
+    //======================Presets==================================
+    addAndMakeVisible(presetComboBox);
+    presetComboBox.setTextWhenNothingSelected("Presets");
+    for (int i = 0; i < getNumNetlistPresets(); ++i) {
+        presetComboBox.addItem(getNetlistPreset(i).name, i + 1);
+    }
+    //through the program of the processor, so that the host shows it
+    presetComboBox.onChange = [this] {
+        if (presetComboBox.getSelectedId() > 0) {
+            audioProcessor.setCurrentProgram(presetComboBox.getSelectedId() - 1);
+            audioProcessor.updateHostDisplay();
+        }
+    };
+
+    //======================Render Button==================================
+    addAndMakeVisible(renderButton);
+    renderButton.setButtonText("Render file...");
+    renderButton.onClick = [this] { renderButtonClicked(); };
+
+    updateNetlistText();
+
+    setSize(600, 620);
 }
 
 
@@ -121,16 +161,53 @@ void Test_MNAlgorithm_v1_4AudioProcessorEditor::readFile(const juce::File& fileT
     if (!fileToRead.existsAsFile())
         return;
     audioProcessor.loadNetlistFile(fileToRead.getFullPathName());
-    auto fileText = fileToRead.loadFileAsString();
-    textContent->setText(fileText);
+    audioProcessor.updateHostDisplay();
+    updateNetlistText();
+}
+
+void Test_MNAlgorithm_v1_4AudioProcessorEditor::updateNetlistText()
+{
+    textContent->setText(audioProcessor.netlistText);
+    presetComboBox.setSelectedId(audioProcessor.currentPreset + 1, juce::dontSendNotification);
+    if (audioProcessor.netlistPath.isNotEmpty()) {
+        fileComp->setCurrentFile(juce::File(audioProcessor.netlistPath), false, juce::dontSendNotification);
+    }
 }
 
 void Test_MNAlgorithm_v1_4AudioProcessorEditor::updateButtonClicked() {
+    const auto text = textContent->getText();
+    //the edits of a preset stay in memory, with the plugin state
     if (audioProcessor.netlistPath.isNotEmpty()) {
         juce::File file(audioProcessor.netlistPath);
-        file.replaceWithText(textContent->getText());
-        readFile(file);
+        file.replaceWithText(text);
     }
+    //value changes are applied without reloading, the circuit keeps its state
+    audioProcessor.applyNetlistEdit(text);
+}
+
+void Test_MNAlgorithm_v1_4AudioProcessorEditor::renderButtonClicked() {
+    renderChooser = std::make_unique<juce::FileChooser>("Select an audio file to render",
+        juce::File::getSpecialLocation(juce::File::userDesktopDirectory), "*.wav;*.aif;*.aiff;*.flac;*.ogg");
+    renderChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this](const juce::FileChooser& chooser) {
+        const auto inputFile = chooser.getResult();
+        if (!inputFile.existsAsFile()) return;
+
+        renderChooser = std::make_unique<juce::FileChooser>("Save the rendered file",
+            inputFile.getSiblingFile(inputFile.getFileNameWithoutExtension() + " (rendered).wav"), "*.wav;*.aif;*.aiff;*.flac");
+        renderChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                                   | juce::FileBrowserComponent::warnAboutOverwriting, [this, inputFile](const juce::FileChooser& chooser) {
+            const auto outputFile = chooser.getResult();
+            if (outputFile == juce::File()) return;
+
+            //the editor may be closed before the render ends, so the callback doesn't refer to it
+            audioProcessor.renderFile(inputFile, outputFile, [](const juce::String& error) {
+                if (error.isNotEmpty()) {
+                    juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Rendering failed", error);
+                }
+            });
+            renderButton.setEnabled(false);
+        });
+    });
 }
 
 
@@ -138,6 +215,12 @@ Test_MNAlgorithm_v1_4AudioProcessorEditor::~Test_MNAlgorithm_v1_4AudioProcessorE
 {
 }
 
+void Test_MNAlgorithm_v1_4AudioProcessorEditor::timerCallback() {
+    qualityLabel.setText(audioProcessor.getQualityDescription(), juce::dontSendNotification);
+    qualityLabel.setColour(juce::Label::textColourId, audioProcessor.getQualityLevel() == 0 ? juce::Colours::grey : juce::Colours::orange);
+    renderButton.setEnabled(!audioProcessor.isRenderingFile());
+}
+
 
 //==============================================================================
 void Test_MNAlgorithm_v1_4AudioProcessorEditor::paint (juce::Graphics& g)
@@ -160,8 +243,15 @@ void Test_MNAlgorithm_v1_4AudioProcessorEditor::resized()
     mixSlider.setBounds(490, 300, 100, 100);
     osComboBox.setBounds(490, 450, 100, 30);
     
-    fileComp->setBounds(20, 50, 360, 30);
+    fileComp->setBounds(20, 50, 250, 30);
+    presetComboBox.setBounds(280, 50, 110, 30);
     updateButton.setBounds(400, 50, 70, 30);
+    renderButton.setBounds(490, 515, 100, 30);
+    qualityLabel.setBounds(330, 15, 140, 20);
     textContent->setBounds(20, 100, 450, 380);
+
+    for (int i = 0; i < Netlist::numKnobs; ++i) {
+        potSliders[i].setBounds(20 + i * 115, 515, 90, 90);
+    }
     
 }
@@ -15,7 +15,8 @@
 /**
 */
 class Test_MNAlgorithm_v1_4AudioProcessorEditor  : public juce::AudioProcessorEditor,
-                                                   public juce::FilenameComponentListener
+                                                   public juce::FilenameComponentListener,
+                                                   private juce::Timer
 {
 public:
     Test_MNAlgorithm_v1_4AudioProcessorEditor 
@@ -26,6 +27,8 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
     void readFile(const juce::File& fileToRead);
+    // Show the text of the current netlist, and where it comes from
+    void updateNetlistText();
 private:
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
@@ -35,24 +38,35 @@ private:
     juce::Slider outputgainSlider;
     juce::Slider mixSlider;
     juce::ComboBox osComboBox;
+    juce::Slider potSliders[Netlist::numKnobs];
 
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>   inputgainAttachement;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>   outputgainAttachement;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>   mixAttachement;
     std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> osComboBoxAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>   potAttachements[Netlist::numKnobs];
 
     juce::Label inputgainLabel;
     juce::Label outputgainLabel;
     juce::Label mixLabel;
     juce::Label osLabel;
+    juce::Label potLabels[Netlist::numKnobs];
+    juce::Label qualityLabel;       // quality level the processor fell back to under CPU pressure
 
     std::unique_ptr<juce::FilenameComponent> fileComp;
     std::unique_ptr<juce::TextEditor> textContent;
     juce::TextButton updateButton;
+    juce::ComboBox presetComboBox;
+    juce::TextButton renderButton;
+    std::unique_ptr<juce::FileChooser> renderChooser;
 
     void filenameComponentChanged(juce::FilenameComponent* fileComponentThatHasChanged);
     
     void updateButtonClicked();
+    // Ask for an audio file and where to save it, then render it through the netlist (see renderFile)
+    void renderButtonClicked();
+
+    void timerCallback() override;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Test_MNAlgorithm_v1_4AudioProcessorEditor)
 };
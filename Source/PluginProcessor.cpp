@@ -8,6 +8,8 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "streamingRenderer.h"
+#include "chunkedRenderer.h"
 
 //==============================================================================
 Test_MNAlgorithm_v1_4AudioProcessor::Test_MNAlgorithm_v1_4AudioProcessor()
@@ -28,7 +30,11 @@ parameters(*this, nullptr, juce::Identifier("CircuitLive"), {
         std::make_unique<juce::AudioParameterFloat>("input gain", "Input Gain", juce::NormalisableRange{ -40.f, 40.f ,0.1f, 1.f, false }, 0.f),
         std::make_unique<juce::AudioParameterFloat>("output gain", "Output Gain", juce::NormalisableRange{ -40.f, 40.f ,0.1f, 1.f, false }, 0.f),
         std::make_unique<juce::AudioParameterInt>("mix", "Mix", 0, 100, 100),
-        std::make_unique<juce::AudioParameterInt>("oversampling","Oversampling", 1, 4, 1)
+        std::make_unique<juce::AudioParameterInt>("oversampling","Oversampling", 1, 4, 1),
+        std::make_unique<juce::AudioParameterFloat>("pot 1", "Pot 1", 0.f, 1.f, 0.5f),
+        std::make_unique<juce::AudioParameterFloat>("pot 2", "Pot 2", 0.f, 1.f, 0.5f),
+        std::make_unique<juce::AudioParameterFloat>("pot 3", "Pot 3", 0.f, 1.f, 0.5f),
+        std::make_unique<juce::AudioParameterFloat>("pot 4", "Pot 4", 0.f, 1.f, 0.5f)
     }) {
 
     inputGainParameter     = parameters.getRawParameterValue("input gain");
@@ -36,15 +42,32 @@ parameters(*this, nullptr, juce::Identifier("CircuitLive"), {
     mixPercentageParameter = parameters.getRawParameterValue("mix");
     oversamplingParameter  = parameters.getRawParameterValue("oversampling");
 
+    for (int i = 0; i < Netlist::numKnobs; ++i) {
+        knobParameters[i] = parameters.getRawParameterValue("pot " + juce::String(i + 1));
+    }
+
     //initialize all the "oversamplers"
     for (int i = 0; i < 3; ++i) {
         oversampler[i] = std::make_unique<juce::dsp::Oversampling<float>>(getTotalNumInputChannels(), i + 1,
             juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR);
     }
+
+    modelThread = std::thread([this] { runModelThread(); });
+    startTimer(500);
 };
 
 Test_MNAlgorithm_v1_4AudioProcessor::~Test_MNAlgorithm_v1_4AudioProcessor()
 {
+    stopTimer();
+    if (selectorThread.joinable()) selectorThread.join();
+    {
+        std::lock_guard<std::mutex> lock(modelMutex);
+        stopModelThread = true;
+    }
+    modelCondition.notify_all();
+    modelThread.join();
+    stopRendering = true;
+    if (renderThread.joinable()) renderThread.join();
 }
 
 //==============================================================================
@@ -85,40 +108,133 @@ double Test_MNAlgorithm_v1_4AudioProcessor::getTailLengthSeconds() const
     return 0.0;
 }
 
+// The programs are the netlist presets (see presetBank.h)
 int Test_MNAlgorithm_v1_4AudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return std::max(getNumNetlistPresets(), 1);   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+                                                  // so this should be at least 1, even if you're not really implementing programs.
 }
 
 int Test_MNAlgorithm_v1_4AudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return std::max(currentPreset, 0);
 }
 
 void Test_MNAlgorithm_v1_4AudioProcessor::setCurrentProgram (int index)
 {
+    //hosts set the current program again when restoring a session, which mustn't replace a netlist loaded from a file
+    if (index == currentPreset || index < 0 || index >= getNumNetlistPresets()) return;
+    loadPreset(index);
+
+    if (auto* editor = dynamic_cast<Test_MNAlgorithm_v1_4AudioProcessorEditor*>(getActiveEditor())) {
+        editor->updateNetlistText();
+    }
 }
 
 const juce::String Test_MNAlgorithm_v1_4AudioProcessor::getProgramName (int index)
 {
-    return {};
+    return index >= 0 && index < getNumNetlistPresets() ? juce::String(getNetlistPreset(index).name) : juce::String();
 }
 
 void Test_MNAlgorithm_v1_4AudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
 }
 
-void Test_MNAlgorithm_v1_4AudioProcessor::loadNetlistFile(const juce::String& path) {
+void Test_MNAlgorithm_v1_4AudioProcessor::loadNetlistFile(const juce::String& path, const juce::MemoryBlock* solverState) {
+    // Update the path to the current netlist file even if loading the netlist have failed
+    netlistPath = path;
+    currentPreset = -1;
+    loadNetlistText(juce::File(path).loadFileAsString(), solverState);
+}
+
+void Test_MNAlgorithm_v1_4AudioProcessor::loadPreset(int index) {
+    netlistPath = {};
+    currentPreset = index;
+    loadNetlistText(getNetlistPreset(index).text);
+}
+
+// Load a netlist from its text. The text is kept (and saved with the plugin state) even if loading failed
+void Test_MNAlgorithm_v1_4AudioProcessor::loadNetlistText(const juce::String& text, const juce::MemoryBlock* solverState) {
+    loadGeneration++;
+    auto newNetlist = createNetlist(text, solverState, nullptr);
+    netlistText = text;
+    // Lock and swap
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        //the audio thread may still be processing the old netlist, which mustn't be freed there
+        if (netlist != nullptr) retiredNetlists.push_back(std::move(netlist));
+        netlist = newNetlist; // Atomically replace the old netlist with the new one
+        hasStrategyChoice = false;
+        pendingEdit = nullptr;
+    }
+    startStrategySelection();
+}
+
+void Test_MNAlgorithm_v1_4AudioProcessor::applyNetlistEdit(const juce::String& text) {
+    std::shared_ptr<Netlist> current;
+    StrategyChoice choice;
+    bool hasChoice = false;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        current = netlist;
+        choice = strategyChoice;
+        hasChoice = hasStrategyChoice;
+    }
+
+    //factorized and precomputed here, with the strategy already selected, so that installing it costs the audio thread a copy of the state
+    auto edited = createNetlist(text, nullptr, hasChoice ? &choice : nullptr, current.get());
+    if (current == nullptr || !edited->isInitialized || !edited->hasSameTopology(*current)) {
+        loadNetlistText(text);
+        return;
+    }
+
+    //a selection running on the previous text mustn't install its netlist
+    loadGeneration++;
+    netlistText = text;
+    std::lock_guard<std::mutex> lock(netlistMutex);
+    pendingEdit = edited;
+    pendingEditSeen = false;
+}
+
+// Load a netlist and solve it at the rate processBlock will run it at, with the strategy of choice
+// if given (the default strategy of the netlist otherwise), and prepare the strategy to take over the state
+// of previous if given. Returns the netlist even if loading failed
+std::shared_ptr<Netlist> Test_MNAlgorithm_v1_4AudioProcessor::createNetlist(const juce::String& text, const juce::MemoryBlock* solverState,
+                                                                            const StrategyChoice* choice, const Netlist* previous) {
 
     auto newNetlist = std::make_shared<Netlist>(); // Create a new netlist instance
 
+    //read under the lock, since prepareToPlay may change them while a selection builds its netlist
+    const auto oversamplingIndex = static_cast<int>(oversamplingParameter->load());
+    double sampleRate = 0;
+    int blockSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        sampleRate = currentSampleRate * std::pow(2.0, oversamplingIndex - 1);
+        blockSize = maximumBlockSize;
+    }
+
     try {
-        newNetlist->init(path.toStdString()); // Initialize the new netlist
+        //the knobs are set first, since the operating point of the circuit depends on them
+        for (int i = 0; i < Netlist::numKnobs; ++i) {
+            newNetlist->setKnobPosition(i, knobParameters[i]->load());
+        }
+        newNetlist->initFromText(text.toStdString()); // Initialize the new netlist
         if (newNetlist->isInitialized) {
+            if (choice != nullptr) choice->apply(*newNetlist);
+
+            //at the rate processBlock will run it at, so that it doesn't have to clear the system
             newNetlist->prepareChannels(getTotalNumInputChannels());
-            newNetlist->setSampleRate(currentSampleRate);
+            newNetlist->setSampleRate(sampleRate);
+            newNetlist->solve_operating_point();
             newNetlist->solve_system();
+            newNetlist->precompute_knob_grid();
+            newNetlist->precompute_impulse_response();
+            newNetlist->maximumBlockSize = blockSize;
+            newNetlist->prepareProcessStrategy(previous);
+            if (solverState != nullptr) {
+                newNetlist->restoreState(static_cast<const char*>(solverState->getData()), solverState->getSize());
+            }
             //netlistPath = path;
         }
         
@@ -127,19 +243,314 @@ void Test_MNAlgorithm_v1_4AudioProcessor::loadNetlistFile(const juce::String& pa
         // Handle exceptions or errors later...
         //netlistPath = {};  // Clear the path if loading failed.
     }
-    // Update the path to the current netlist file even if loading the netlist have failed
-    netlistPath = path;
-    // Lock and swap
+    return newNetlist;
+}
+
+bool Test_MNAlgorithm_v1_4AudioProcessor::renderFile(const juce::File& inputFile, const juce::File& outputFile,
+                                                     std::function<void(const juce::String&)> onFinished) {
+    if (netlistText.isEmpty() || renderingFile.exchange(true)) return false;
+    if (renderThread.joinable()) renderThread.join();
+
+    StreamingRenderer renderer(netlistText.toStdString());
+    renderer.settings.inputGain = inputGainParameter->load();
+    renderer.settings.outputGain = outputGainParameter->load();
+    renderer.settings.mixPercentage = mixPercentageParameter->load();
+    for (int i = 0; i < Netlist::numKnobs; ++i) renderer.settings.knobPositions[i] = knobParameters[i]->load();
+    renderer.shouldStop = &stopRendering;
+    ChunkedRenderer chunkedRenderer(netlistText.toStdString());
+    chunkedRenderer.settings = renderer.settings;
+    chunkedRenderer.shouldStop = &stopRendering;
+
+    renderThread = std::thread([this, renderer, chunkedRenderer, inputFile, outputFile, onFinished]() mutable {
+        juce::String error;
+        try {
+            //in chunks on all the cores when the file fits in memory, streamed otherwise
+            if (chunkedRenderer.canRender(inputFile)) chunkedRenderer.render(inputFile, outputFile);
+            else renderer.render(inputFile, outputFile);
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+        }
+        renderingFile = false;
+        if (onFinished) juce::MessageManager::callAsync([onFinished, error] { onFinished(error); });
+    });
+    return true;
+}
+
+// Benchmark the strategies on a copy of the current netlist, then prepare the fastest one in a new netlist,
+// installed like an edit: processBlock switches to it at a block boundary, where it takes over the state of
+// the current one. Skipped while a selection is running
+void Test_MNAlgorithm_v1_4AudioProcessor::startStrategySelection() {
+    //the thread only gets copies: currentSampleRate is written by prepareToPlay, under the lock
+    const auto oversamplingIndex = static_cast<int>(oversamplingParameter->load());
+    RenderSettings settings;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        settings.sampleRate = currentSampleRate * std::pow(2.0, oversamplingIndex - 1);
+    }
+    if (settings.sampleRate <= 0 || netlistText.isEmpty() || selecting.exchange(true)) return;
+    if (selectorThread.joinable()) selectorThread.join();
+
+    settings.inputGain = inputGainParameter->load();
+    settings.outputGain = outputGainParameter->load();
+    for (int i = 0; i < Netlist::numKnobs; ++i) settings.knobPositions[i] = knobParameters[i]->load();
+
+    const auto text = netlistText;
+    const unsigned generation = loadGeneration;
+    selectorThread = std::thread([this, text, settings, generation] {
+        try {
+            StrategySelector selector(text.toStdString());
+            selector.settings = settings;
+            const auto choice = selector.select();
+
+            std::shared_ptr<Netlist> current;
+            {
+                std::lock_guard<std::mutex> lock(netlistMutex);
+                current = netlist;
+                if (hasStrategyChoice && choice == strategyChoice) current = nullptr;
+            }
+            if (current != nullptr && current->isInitialized && generation == loadGeneration) {
+                auto newNetlist = createNetlist(text, nullptr, &choice, current.get());
+
+                //prepareToPlay may have changed the rate meanwhile, the selection then being run again for it
+                std::lock_guard<std::mutex> lock(netlistMutex);
+                const double rate = currentSampleRate * std::pow(2.0, static_cast<int>(oversamplingParameter->load()) - 1);
+                if (newNetlist->sampleRate != settings.sampleRate || rate != settings.sampleRate) {
+                    reselectionRequested = true;
+                }
+                else if (newNetlist->hasSameTopology(*current) && generation == loadGeneration) {
+                    pendingEdit = newNetlist;
+                    pendingEditSeen = false;
+                    strategyChoice = choice;
+                    hasStrategyChoice = true;
+                }
+            }
+        }
+        catch (...) {
+            // The current strategy is kept
+        }
+        selecting = false;
+
+        //a netlist loaded during the selection gets its own
+        if (generation != loadGeneration) reselectionRequested = true;
+    });
+}
+
+// The audio thread only flags sustained overruns; the selection is started from here
+void Test_MNAlgorithm_v1_4AudioProcessor::timerCallback() {
+    if (reselectionRequested.exchange(false)) startStrategySelection();
+
+    //edits are installed by processBlock, or here when no block has been processed since the previous callback
+    std::vector<std::shared_ptr<Netlist>> released;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        if (retiredNetlist != nullptr) retiredNetlists.push_back(std::move(retiredNetlist));
+        if (pendingEdit != nullptr && pendingEditSeen) {
+            if (netlist != nullptr) pendingEdit->copyStateFrom(*netlist);
+            retiredNetlists.push_back(std::move(netlist));
+            netlist = std::move(pendingEdit);
+        }
+        pendingEditSeen = pendingEdit != nullptr;
+
+        //the replaced netlists can't be reached anymore: those only held here are freed below, outside of the lock
+        for (auto& retired : retiredNetlists) {
+            if (retired.use_count() == 1) released.push_back(std::move(retired));
+        }
+        retiredNetlists.erase(std::remove(retiredNetlists.begin(), retiredNetlists.end(), nullptr), retiredNetlists.end());
+    }
+}
+
+// Identify the sub-block models requested by the audio thread, one at a time, as soon as it requests them (once the
+// knobs have stopped moving), and build the netlist again when the oversampling factor changes or, for a convolution,
+// when the knobs settle away from the positions of its impulse response. The audio thread
+// only raises a flag, which is polled here, since it can't signal this thread without a system call; it solves per
+// sample until the model is ready, and at the previous factor until the netlist for the new one is installed
+void Test_MNAlgorithm_v1_4AudioProcessor::runModelThread() {
+    std::unique_lock<std::mutex> lock(modelMutex);
+    while (!modelCondition.wait_for(lock, modelPollInterval, [this] { return stopModelThread; })) {
+        lock.unlock();
+        updateOversampling();
+        updateImpulseResponse();
+
+        std::shared_ptr<Netlist> current;
+        {
+            std::lock_guard<std::mutex> netlistLock(netlistMutex);
+            current = netlist;
+        }
+        if (current != nullptr && current->blockModelBuilder.isRebuildRequested()) current->blockModelBuilder.rebuild();
+        lock.lock();
+    }
+}
+
+// Build the netlist for the rate of the oversampling parameter, if it isn't running at it, and hand it to processBlock
+// like an edit. The system, the knob grid, the impulse response and the strategy are all prepared here for the new rate
+void Test_MNAlgorithm_v1_4AudioProcessor::updateOversampling() {
+    std::shared_ptr<Netlist> current, pending;
+    StrategyChoice choice;
+    bool hasChoice = false;
+    double rate = 0;
+    unsigned generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        rate = currentSampleRate * std::pow(2.0, static_cast<int>(oversamplingParameter->load()) - 1);
+        current = netlist;
+        pending = pendingEdit;
+        choice = strategyChoice;
+        hasChoice = hasStrategyChoice;
+        generation = loadGeneration;
+    }
+
+    //an edit waiting to be installed is the one built again, so that it isn't lost
+    const auto& source = pending != nullptr ? pending : current;
+    if (rate <= 0 || source == nullptr || !source->isInitialized || source->sampleRate == rate) return;
+
+    auto rebuilt = createNetlist(juce::String(source->sourceText), nullptr, hasChoice ? &choice : nullptr, current.get());
+
+    //dropped if anything was loaded or installed meanwhile, this being called again for it
     std::lock_guard<std::mutex> lock(netlistMutex);
-    netlist = newNetlist; // Atomically replace the old netlist with the new one
+    if (rebuilt->isInitialized && rebuilt->sampleRate == rate && generation == loadGeneration && netlist == current && pendingEdit == pending) {
+        pendingEdit = std::move(rebuilt);
+        pendingEditSeen = false;
+    }
+}
+
+// Build the netlist again, with the impulse response for the current knob positions, once they have stayed
+// the same for impulseSettleTime, and hand it to processBlock like an edit. Until it is installed, the
+// convolution strategy solves the circuit directly (see ConvolutionProcessStrategy)
+void Test_MNAlgorithm_v1_4AudioProcessor::updateImpulseResponse() {
+    std::shared_ptr<Netlist> current;
+    StrategyChoice choice;
+    bool hasChoice = false;
+    unsigned generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        current = netlist;
+        choice = strategyChoice;
+        hasChoice = hasStrategyChoice;
+        generation = loadGeneration;
+        if (pendingEdit != nullptr) return;
+    }
+    if (current == nullptr || !current->isInitialized || current->linearStrategy != Netlist::LinearStrategy::Convolution
+        || !current->nonlinearComponents.empty() || current->potentiometers.empty()) {
+        return;
+    }
+
+    //the knobs must have stayed the same for a few polls
+    bool moved = false;
+    for (int i = 0; i < Netlist::numKnobs; ++i) {
+        const float position = knobParameters[i]->load();
+        moved = moved || position != polledKnobPositions[i];
+        polledKnobPositions[i] = position;
+    }
+    if (moved) knobSettlePolls = 0;
+    else if (knobSettlePolls * modelPollInterval < impulseSettleTime) knobSettlePolls++;
+    if (knobSettlePolls * modelPollInterval < impulseSettleTime) return;
+
+    bool matches = current->impulseResponseKnobs.size() == current->potentiometers.size();
+    for (size_t j = 0; matches && j < current->potentiometers.size(); j++) {
+        matches = current->impulseResponseKnobs[j] == double(polledKnobPositions[current->potentiometers[j]->knob]);
+    }
+    if (matches) return;
+
+    auto rebuilt = createNetlist(juce::String(current->sourceText), nullptr, hasChoice ? &choice : nullptr, current.get());
+
+    //dropped if anything was loaded or installed meanwhile
+    std::lock_guard<std::mutex> lock(netlistMutex);
+    if (rebuilt->isInitialized && rebuilt->sampleRate == current->sampleRate && generation == loadGeneration
+        && netlist == current && pendingEdit == nullptr) {
+        pendingEdit = std::move(rebuilt);
+        pendingEditSeen = false;
+    }
+}
+
+// Oversampling index (as the parameter: 1 for none) of a netlist, from the rate it was built for
+int Test_MNAlgorithm_v1_4AudioProcessor::getOversamplingIndex(const Netlist& netlist) const {
+    const int index = 1 + int(std::lround(std::log2(netlist.sampleRate / currentSampleRate)));
+    return std::clamp(index, 1, int(std::size(oversampler)) + 1);
+}
+
+const Test_MNAlgorithm_v1_4AudioProcessor::QualityLevel Test_MNAlgorithm_v1_4AudioProcessor::qualityLevels[numQualityLevels] = {
+    { 15, "Full quality" },
+    { 6,  "6 Newton iterations" },
+    { 3,  "3 Newton iterations" },
+    { 1,  "Linearized" }
+};
+
+juce::String Test_MNAlgorithm_v1_4AudioProcessor::getQualityDescription() const {
+    return qualityLevels[qualityLevel.load()].description;
+}
+
+// Next level in the given direction (+1 lower quality, -1 higher) whose effect differs from the current one,
+// taking the first of the equivalent levels. Returns the same level at either end
+int Test_MNAlgorithm_v1_4AudioProcessor::getNextQualityLevel(int level, int direction, bool isLinear) const {
+    auto isEquivalent = [&](int lhs, int rhs) {
+        return isLinear || qualityLevels[lhs].maxNewtonIterations == qualityLevels[rhs].maxNewtonIterations;
+    };
+
+    int next = level + direction;
+    while (next >= 0 && next < numQualityLevels && isEquivalent(next, level)) next += direction;
+    if (next < 0 || next >= numQualityLevels) return level;
+    while (next > 0 && isEquivalent(next - 1, next)) next--;
+    return next;
+}
+
+// Called on the audio thread after each block, with the solve time relative to the block duration
+void Test_MNAlgorithm_v1_4AudioProcessor::updateQuality(double load, int numSamples, bool isLinear) {
+    const double seconds = numSamples / currentSampleRate;
+    const int level = qualityLevel.load();
+    secondsSinceStepUp += seconds;
+
+    if (load > stepDownLoad) {
+        const int lower = getNextQualityLevel(level, 1, isLinear);
+        if (lower != level) {
+            //the level stepped up to didn't hold, so wait longer before trying it again
+            if (secondsSinceStepUp < minStepUpSeconds) stepUpSeconds = std::min(2 * stepUpSeconds, maxStepUpSeconds);
+            qualityLevel = lower;
+        }
+        secondsBelowStepUpLoad = 0;
+        return;
+    }
+
+    secondsBelowStepUpLoad = load < stepUpLoad ? secondsBelowStepUpLoad + seconds : 0;
+    if (secondsBelowStepUpLoad >= stepUpSeconds && level > 0) {
+        qualityLevel = getNextQualityLevel(level, -1, isLinear);
+        secondsBelowStepUpLoad = 0;
+        secondsSinceStepUp = 0;
+    }
 }
 
 //==============================================================================
 void Test_MNAlgorithm_v1_4AudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    currentSampleRate = sampleRate;
     for (auto& os : oversampler)
         os->initProcessing(samplesPerBlock);
+
+    //rebuild the system, the knob grid and the impulse response, for the rate the netlist will actually run at
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        currentSampleRate = sampleRate;
+        maximumBlockSize = samplesPerBlock << std::size(oversampler);
+        if (netlist && netlist->isInitialized) {
+            const auto oversamplingIndex = static_cast<int>(oversamplingParameter->load());
+            netlist->setSampleRate(sampleRate * std::pow(2.0, oversamplingIndex - 1));
+            netlist->clear_system();
+            netlist->solve_system();
+            netlist->precompute_knob_grid();
+            netlist->precompute_impulse_response();
+            netlist->maximumBlockSize = maximumBlockSize;
+            netlist->prepareProcessStrategy();
+        }
+    }
+    overrunScore = 0;
+    qualityLevel = 0;
+    secondsBelowStepUpLoad = 0;
+    secondsSinceStepUp = 0;
+    stepUpSeconds = minStepUpSeconds;
+    lastOversamplingIndex = 0;
+    lastOutputs.assign(size_t(getTotalNumOutputChannels()), 0.0f);
+
+    //the fastest strategy depends on the rate
+    startStrategySelection();
 }
 
 void Test_MNAlgorithm_v1_4AudioProcessor::releaseResources()
@@ -188,6 +599,13 @@ void Test_MNAlgorithm_v1_4AudioProcessor::processBlock (juce::AudioBuffer<float>
 
     {
         std::lock_guard<std::mutex> lock(netlistMutex);
+        //an edited netlist continues from the state of the one it replaces, at the block boundary; the one
+        //replaced before must have been taken by the timer, so that it isn't freed here
+        if (pendingEdit != nullptr && retiredNetlist == nullptr) {
+            if (netlist != nullptr) pendingEdit->copyStateFrom(*netlist);
+            retiredNetlist = std::move(netlist);
+            netlist = std::move(pendingEdit);
+        }
         localNetlist = netlist; // Copy the shared_ptr
     }
 
@@ -200,21 +618,32 @@ void Test_MNAlgorithm_v1_4AudioProcessor::processBlock (juce::AudioBuffer<float>
     const auto inputGain = inputGainParameter->load();
     const auto outputGain = outputGainParameter->load();
     const auto mixPercentage = mixPercentageParameter->load();
-    const auto oversamplingIndex = static_cast<int>(oversamplingParameter->load());
+
+    //under CPU pressure, fewer Newton iterations are used (see updateQuality)
+    const auto& quality = qualityLevels[isNonRealtime() ? 0 : qualityLevel.load()];
+    //the factor the netlist was built for: runModelThread builds it again when the parameter changes
+    const int oversamplingIndex = getOversamplingIndex(*localNetlist);
+    localNetlist->maxNewtonIterations = quality.maxNewtonIterations;
 
     localNetlist->setInputGain(inputGain);
     localNetlist->setOutputGain(outputGain);
     localNetlist->setMixPercentage(mixPercentage);
 
+    for (int i = 0; i < Netlist::numKnobs; ++i) {
+        localNetlist->setKnobPosition(i, knobParameters[i]->load());
+    }
+
+
+    localNetlist->setOfflineRendering(isNonRealtime());
 
-    const double effectiveSampleRate = currentSampleRate * std::pow(2.0, oversamplingIndex - 1);
-    if (effectiveSampleRate != localNetlist->sampleRate) {
-        localNetlist->setSampleRate(effectiveSampleRate);
-        localNetlist->clear_system();
-        localNetlist->solve_system();
+    //the oversampling filters switched to start from rest
+    const bool oversamplingChanged = lastOversamplingIndex != 0 && oversamplingIndex != lastOversamplingIndex;
+    if (oversamplingChanged && oversamplingIndex > 1) {
+        oversampler[oversamplingIndex - 2]->reset();
     }
 
 
+    const auto processingStart = juce::Time::getHighResolutionTicks();
     juce::dsp::AudioBlock<float> inputblock{ buffer };
 
     if (oversamplingIndex > 1) {
@@ -225,7 +654,42 @@ void Test_MNAlgorithm_v1_4AudioProcessor::processBlock (juce::AudioBuffer<float>
     else {
         localNetlist->processBlock(inputblock);
     }
-    
+
+    const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - processingStart);
+
+    //crossfade from the last output of the previous block when the oversampling changed, since the
+    //filters of the new factor have another latency
+    const int numOutputChannels = std::min(buffer.getNumChannels(), int(lastOutputs.size()));
+    if (oversamplingChanged) {
+        const int transitionSamples = std::min(buffer.getNumSamples(), int(0.005 * currentSampleRate) + 1);
+        for (int channel = 0; channel < numOutputChannels; ++channel) {
+            auto* samples = buffer.getWritePointer(channel);
+            for (int i = 0; i < transitionSamples; ++i) {
+                const float ratio = float(i + 1) / float(transitionSamples);
+                samples[i] = (1.0f - ratio) * lastOutputs[channel] + ratio * samples[i];
+            }
+        }
+    }
+    for (int channel = 0; channel < numOutputChannels && buffer.getNumSamples() > 0; ++channel) {
+        lastOutputs[channel] = buffer.getSample(channel, buffer.getNumSamples() - 1);
+    }
+    lastOversamplingIndex = oversamplingIndex;
+
+    if (!isNonRealtime() && currentSampleRate > 0 && buffer.getNumSamples() > 0) {
+        const double load = elapsed * currentSampleRate / buffer.getNumSamples();
+        updateQuality(load, buffer.getNumSamples(), localNetlist->nonlinearComponents.empty());
+    }
+
+    //sustained overruns trigger a new strategy selection, on the message thread
+    if (!isNonRealtime() && currentSampleRate > 0 && elapsed > overrunLoad * buffer.getNumSamples() / currentSampleRate) {
+        if (++overrunScore >= sustainedOverrunScore) {
+            overrunScore = 0;
+            reselectionRequested = true;
+        }
+    }
+    else if (overrunScore > 0) {
+        overrunScore--;
+    }
 }
 
 //==============================================================================
@@ -247,6 +711,20 @@ void Test_MNAlgorithm_v1_4AudioProcessor::getStateInformation (juce::MemoryBlock
 
     // Add the netlist path as a new child element.
     xml->setAttribute("netlistPath", netlistPath);
+    // and the netlist itself, so that the session doesn't depend on the file
+    xml->setAttribute("netlistText", netlistText);
+    xml->setAttribute("preset", currentPreset);
+
+    // Snapshot of the circuit state, so that a recalled session resumes without re-settling
+    std::shared_ptr<Netlist> localNetlist;
+    {
+        std::lock_guard<std::mutex> lock(netlistMutex);
+        localNetlist = netlist;
+    }
+    if (localNetlist && localNetlist->isInitialized) {
+        const auto snapshot = localNetlist->saveState();
+        xml->setAttribute("solverState", juce::MemoryBlock(snapshot.data(), snapshot.size()).toBase64Encoding());
+    }
 
     copyXmlToBinary(*xml, destData);
 }
@@ -260,12 +738,23 @@ void Test_MNAlgorithm_v1_4AudioProcessor::setStateInformation (const void* data,
 
         // Read the netlist path attribute and update the member variable.
         if (xmlState->hasAttribute("netlistPath")) {
-            netlistPath = xmlState->getStringAttribute("netlistPath");
-            loadNetlistFile(netlistPath);  // Optionally reload the netlist file
+            juce::MemoryBlock solverState;
+            const bool hasSolverState = solverState.fromBase64Encoding(xmlState->getStringAttribute("solverState"));
+            const auto* resumeState = hasSolverState && solverState.getSize() > 0 ? &solverState : nullptr;
+
+            //the netlist saved with the state, without reading the file; older sessions only have the path
+            if (xmlState->hasAttribute("netlistText")) {
+                netlistPath = xmlState->getStringAttribute("netlistPath");
+                currentPreset = xmlState->getIntAttribute("preset", -1);
+                loadNetlistText(xmlState->getStringAttribute("netlistText"), resumeState);
+            }
+            else {
+                loadNetlistFile(xmlState->getStringAttribute("netlistPath"), resumeState);
+            }
             
             // Notify the editor to update its content if it's visible
             if (auto* editor = dynamic_cast<Test_MNAlgorithm_v1_4AudioProcessorEditor*>(getActiveEditor())) {
-                editor->readFile(netlistPath);
+                editor->updateNetlistText();
             }
         }
     }
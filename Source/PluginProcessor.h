@@ -10,10 +10,18 @@
 
 #include <JuceHeader.h>
 #include "netlist.h"
+#include "strategySelector.h"
+#include "presetBank.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <thread>
 //==============================================================================
 /**
 */
-class Test_MNAlgorithm_v1_4AudioProcessor  : public juce::AudioProcessor
+class Test_MNAlgorithm_v1_4AudioProcessor  : public juce::AudioProcessor,
+                                             private juce::Timer
 {
 public:
     //==============================================================================
@@ -57,11 +65,31 @@ public:
     std::shared_ptr<Netlist> netlist;
     std::mutex netlistMutex;
 
-    void loadNetlistFile(const juce::String& path);
+    // solverState, if given, is a snapshot from Netlist::saveState to resume from
+    void loadNetlistFile(const juce::String& path, const juce::MemoryBlock* solverState = nullptr);
+    void loadNetlistText(const juce::String& text, const juce::MemoryBlock* solverState = nullptr);
+    void loadPreset(int index);
 
-    double currentSampleRate = 0.0;
+    // Apply an edit of the text of the current netlist. When only values changed, the edited netlist is prepared
+    // here and takes over the state of the current one at the start of the next block; other edits reload it
+    void applyNetlistEdit(const juce::String& text);
 
-    juce::String netlistPath;
+    double currentSampleRate = 0.0;    // written by prepareToPlay under netlistMutex, read under it off the audio thread
+
+    // Current quality level, 0 being full quality (see qualityLevels), for the editor
+    int getQualityLevel() const { return qualityLevel.load(); }
+    juce::String getQualityDescription() const;
+
+    // Render an audio file through the current netlist and settings on a background thread, at the rate of the
+    // file: in parallel chunks when it fits in memory (see ChunkedRenderer), streamed otherwise (see StreamingRenderer).
+    // onFinished is called on the message thread with the error, empty on success. Returns false if a render is
+    // already running
+    bool renderFile(const juce::File& inputFile, const juce::File& outputFile, std::function<void(const juce::String&)> onFinished);
+    bool isRenderingFile() const { return renderingFile; }
+
+    juce::String netlistPath;       // file the netlist was loaded from and edits are saved to, empty for a preset
+    juce::String netlistText;       // text of the current netlist, saved with the plugin state
+    int currentPreset = -1;         // preset the netlist was loaded from, -1 for a file
 
 private:
 
@@ -71,9 +99,75 @@ private:
     std::atomic<float>* outputGainParameter = nullptr;
     std::atomic<float>* mixPercentageParameter = nullptr;
     std::atomic<float>* oversamplingParameter = nullptr;
+    std::atomic<float>* knobParameters[Netlist::numKnobs] = {};
 
     std::unique_ptr<juce::dsp::Oversampling<float>> oversampler[3];
 
+    // The strategy is selected on a background thread after each load (see StrategySelector),
+    // and again when processing keeps taking more than overrunLoad of the block duration
+    std::shared_ptr<Netlist> createNetlist(const juce::String& text, const juce::MemoryBlock* solverState, const StrategyChoice* choice,
+                                           const Netlist* previous = nullptr);
+    void startStrategySelection();
+    void timerCallback() override;
+    void runModelThread();
+    void updateOversampling();
+    void updateImpulseResponse();
+    int getOversamplingIndex(const Netlist& netlist) const;
+
+    std::thread selectorThread;
+    std::atomic<bool> selecting{ false };
+    std::thread modelThread;                        // sub-block models requested by the audio thread, oversampling changes
+    std::mutex modelMutex;
+    std::condition_variable modelCondition;         // wakes modelThread up to stop it
+    bool stopModelThread = false;                   // guarded by modelMutex
+    static constexpr std::chrono::milliseconds modelPollInterval{ 5 };
+    static constexpr std::chrono::milliseconds impulseSettleTime{ 200 };
+    float polledKnobPositions[Netlist::numKnobs] = {};  // modelThread state, for updateImpulseResponse
+    int knobSettlePolls = 0;
+    std::thread renderThread;                       // renderFile
+    std::atomic<bool> renderingFile{ false };
+    std::atomic<bool> stopRendering{ false };       // set when the processor is destroyed
+    std::atomic<bool> reselectionRequested{ false };
+    std::atomic<unsigned> loadGeneration{ 0 };     // incremented by each load, so that a stale selection isn't installed
+    StrategyChoice strategyChoice;                  // installed by the last selection, guarded by netlistMutex
+    bool hasStrategyChoice = false;
+    std::shared_ptr<Netlist> pendingEdit;           // value-only edit for processBlock to install, guarded by netlistMutex
+    bool pendingEditSeen = false;                   // by the previous timer callback, without audio running to install it
+    std::shared_ptr<Netlist> retiredNetlist;        // replaced by processBlock, no other edit installed until the timer takes it
+    std::vector<std::shared_ptr<Netlist>> retiredNetlists;  // released by the timer once only held here, guarded by netlistMutex
+    int maximumBlockSize = 0;                       // at the highest oversampling factor, set by prepareToPlay like currentSampleRate
+    int overrunScore = 0;                           // +1 per overrun block, -1 per block in time (audio thread)
+    static constexpr double overrunLoad = 0.8;
+    static constexpr int sustainedOverrunScore = 200;
+
+    // Deadline-aware quality control. When a block takes more than stepDownLoad of its duration, the quality
+    // steps down one level: fewer Newton iterations, then a single linearized iteration per sample. It steps
+    // back up after stepUpSeconds below stepUpLoad, that delay doubling when the level it stepped up to doesn't
+    // hold. The levels make no difference to a linear circuit, which stays at full quality. The oversampling
+    // factor isn't lowered: the netlist is built again for a new rate on the model thread, far too slowly to
+    // relieve an overrun.
+    // Offline rendering always runs at full quality
+    struct QualityLevel {
+        unsigned maxNewtonIterations;
+        const char* description;
+    };
+    static constexpr int numQualityLevels = 4;
+    static const QualityLevel qualityLevels[numQualityLevels];
+    static constexpr double stepDownLoad = 0.9;
+    static constexpr double stepUpLoad = 0.5;
+    static constexpr double minStepUpSeconds = 2.0;
+    static constexpr double maxStepUpSeconds = 32.0;
+
+    int getNextQualityLevel(int level, int direction, bool isLinear) const;
+    void updateQuality(double load, int numSamples, bool isLinear);
+
+    std::atomic<int> qualityLevel{ 0 };
+    double secondsBelowStepUpLoad = 0;      // audio thread state
+    double secondsSinceStepUp = 0;
+    double stepUpSeconds = minStepUpSeconds;
+    int lastOversamplingIndex = 0;
+    std::vector<float> lastOutputs;         // last output sample of each channel, to crossfade from
+
     
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Test_MNAlgorithm_v1_4AudioProcessor)
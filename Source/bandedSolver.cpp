@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    bandedSolver.cpp
+    Created: 19 Oct 2026 7:26:02pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "bandedSolver.h"
+#include "graphOrdering.h"
+#include <algorithm>
+#include <cmath>
+
+
+void BandedSolver::analyse(const std::vector<std::vector<unsigned>>& pattern) {
+    size = unsigned(pattern.size());
+
+    //the ordering is computed on the symmetrized pattern
+    std::vector<std::vector<unsigned>> adjacency(size);
+    for (unsigned row = 0; row < size; row++) {
+        for (auto col : pattern[row]) {
+            if (col == row) continue;
+            adjacency[row].push_back(col);
+            adjacency[col].push_back(row);
+        }
+    }
+    for (auto& neighbours : adjacency) {
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    }
+
+    order = reverseCuthillMcKee(adjacency);
+    bandwidth = ::getBandwidth(pattern, order);
+
+    //row i keeps the columns i - bw to i + 2.bw, the upper part growing with the row interchanges
+    band.resize(size, 3 * bandwidth + 1);
+    pivots.resize(size);
+    work.resize(size);
+}
+
+
+bool BandedSolver::factorize(const Eigen::Ref<const Eigen::MatrixXd>& matrix) {
+    band.setZero();
+    for (unsigned i = 0; i < size; i++) {
+        const unsigned first = i > bandwidth ? i - bandwidth : 0;
+        const unsigned last = std::min(size - 1, i + bandwidth);
+        for (unsigned j = first; j <= last; j++) {
+            at(i, j) = matrix(order[i], order[j]);
+        }
+    }
+
+    for (unsigned k = 0; k < size; k++) {
+        const unsigned lastRow = std::min(size - 1, k + bandwidth);
+        const unsigned lastCol = std::min(size - 1, k + 2 * bandwidth);
+
+        unsigned pivot = k;
+        for (unsigned i = k + 1; i <= lastRow; i++) {
+            if (std::abs(at(i, k)) > std::abs(at(pivot, k))) pivot = i;
+        }
+        pivots[k] = pivot;
+        if (pivot != k) {
+            for (unsigned j = k; j <= lastCol; j++) std::swap(at(k, j), at(pivot, j));
+        }
+
+        //partial pivoting inside the band sees the whole column, so a zero pivot means a singular matrix
+        const double diagonal = at(k, k);
+        if (diagonal == 0.0 || !std::isfinite(diagonal)) return false;
+
+        for (unsigned i = k + 1; i <= lastRow; i++) {
+            const double factor = at(i, k) / diagonal;
+            if (factor == 0.0) continue;
+            at(i, k) = factor;
+            for (unsigned j = k + 1; j <= lastCol; j++) at(i, j) -= factor * at(k, j);
+        }
+    }
+    return true;
+}
+
+
+void BandedSolver::solve(const Eigen::Ref<const Eigen::VectorXd>& rhs, Eigen::Ref<Eigen::VectorXd> solution) {
+    for (unsigned i = 0; i < size; i++) work(i) = rhs(order[i]);
+
+    //forward substitution, the row interchanges being applied as they were during the factorization
+    for (unsigned k = 0; k < size; k++) {
+        if (pivots[k] != k) std::swap(work(k), work(pivots[k]));
+        const unsigned lastRow = std::min(size - 1, k + bandwidth);
+        for (unsigned i = k + 1; i <= lastRow; i++) work(i) -= at(i, k) * work(k);
+    }
+
+    //back substitution
+    for (unsigned i = size; i-- > 0;) {
+        const unsigned lastCol = std::min(size - 1, i + 2 * bandwidth);
+        double sum = work(i);
+        for (unsigned j = i + 1; j <= lastCol; j++) sum -= at(i, j) * work(j);
+        work(i) = sum / at(i, i);
+    }
+
+    for (unsigned i = 0; i < size; i++) solution(order[i]) = work(i);
+}
+
+
+void BandedSolver::clear() {
+    order.clear();
+    pivots.clear();
+    band.resize(0, 0);
+    size = 0;
+    bandwidth = 0;
+}
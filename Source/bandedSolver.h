@@ -0,0 +1,40 @@
+/*
+  ==============================================================================
+
+    bandedSolver.h
+    Created: 19 Oct 2026 7:26:02pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+
+// LU solver for matrices whose non-zero entries stay within a narrow band around the diagonal,
+// like the ones of RC/LC ladders. The system is first reordered (reverse Cuthill-McKee),
+// then factorized with partial pivoting inside the band (as LAPACK's gbtrf), so that the
+// factorization costs O(N.bw^2) and each solve O(N.bw) instead of O(N^3) and O(N^2).
+class BandedSolver {
+public:
+    // pattern[i] lists the columns of the non-zero entries of row i
+    void analyse(const std::vector<std::vector<unsigned>>& pattern);
+    // fails on a zero pivot, the matrix being singular
+    bool factorize(const Eigen::Ref<const Eigen::MatrixXd>& matrix);
+    void solve(const Eigen::Ref<const Eigen::VectorXd>& rhs, Eigen::Ref<Eigen::VectorXd> solution);
+    void clear();
+
+    unsigned getBandwidth() const { return bandwidth; }
+    double getSolveCost() const { return double(size) * (3 * bandwidth + 1); }
+
+private:
+    double& at(unsigned row, unsigned col) { return band(row, col + bandwidth - row); }
+
+    std::vector<unsigned> order;    // order[i] = row/column of the original matrix at position i
+    std::vector<unsigned> pivots;
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> band;
+    Eigen::VectorXd work;
+    unsigned size = 0;
+    unsigned bandwidth = 0;
+};
@@ -0,0 +1,226 @@
+/*
+  ==============================================================================
+
+    blockSolver.cpp
+    Created: 19 Oct 2026 2:47:18pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "blockSolver.h"
+#include <algorithm>
+#include <functional>
+
+
+// Match every row to a column of one of its non-zero entries (Kuhn's augmenting paths),
+// so that the permuted matrix has a zero-free diagonal. Fails if A is structurally singular
+bool BlockSolver::findTransversal(const std::vector<std::vector<unsigned>>& pattern, std::vector<int>& rowToCol) {
+    std::vector<int> colToRow(size, -1);
+    std::vector<unsigned> visited(size, 0);
+    unsigned stamp = 0;
+
+    std::function<bool(unsigned)> augment = [&](unsigned row) {
+        for (auto col : pattern[row]) {
+            if (visited[col] == stamp) continue;
+            visited[col] = stamp;
+            if (colToRow[col] < 0 || augment(colToRow[col])) {
+                colToRow[col] = row;
+                rowToCol[row] = col;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    rowToCol.assign(size, -1);
+    for (unsigned row = 0; row < size; row++) {
+        stamp++;
+        if (!augment(row)) return false;
+    }
+    return true;
+}
+
+
+bool BlockSolver::analyse(const std::vector<std::vector<unsigned>>& pattern, const std::vector<size_t>& keys) {
+    clear();
+    size = unsigned(pattern.size());
+
+    std::vector<int> rowToCol;
+    if (size == 0 || !findTransversal(pattern, rowToCol)) {
+        clear();
+        return false;
+    }
+
+    //unknown rowToCol[i] is attached to equation i, and equation i depends on the unknowns of its row
+    std::vector<int> colToRow(size);
+    for (unsigned row = 0; row < size; row++) colToRow[rowToCol[row]] = row;
+
+    //Tarjan's algorithm on "equation i needs the unknown of equation j". Components are emitted
+    //after every component they depend on, which is directly the order in which to solve them
+    std::vector<int> index(size, -1), lowlink(size, 0);
+    std::vector<bool> onStack(size, false);
+    std::vector<unsigned> stack;
+    int counter = 0;
+
+    std::function<void(unsigned)> strongConnect = [&](unsigned v) {
+        index[v] = lowlink[v] = counter++;
+        stack.push_back(v);
+        onStack[v] = true;
+
+        for (auto col : pattern[v]) {
+            const unsigned w = colToRow[col];
+            if (index[w] < 0) {
+                strongConnect(w);
+                lowlink[v] = std::min(lowlink[v], lowlink[w]);
+            }
+            else if (onStack[w]) {
+                lowlink[v] = std::min(lowlink[v], index[w]);
+            }
+        }
+
+        if (lowlink[v] == index[v]) {
+            Block block;
+            unsigned w;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                block.rows.push_back(w);
+                block.cols.push_back(rowToCol[w]);
+            } while (w != v);
+            blocks.push_back(std::move(block));
+        }
+    };
+
+    for (unsigned v = 0; v < size; v++) {
+        if (index[v] < 0) strongConnect(v);
+    }
+
+    solveCost = 0;
+    for (const auto& cols : pattern) solveCost += double(cols.size());
+
+    //the diagonal block may be permuted freely, since it is factorized with row pivoting
+    if (keys.size() == size) {
+        auto byKey = [&keys](unsigned lhs, unsigned rhs) { return keys[lhs] < keys[rhs]; };
+        for (auto& block : blocks) {
+            std::stable_sort(block.rows.begin(), block.rows.end(), byKey);
+            std::stable_sort(block.cols.begin(), block.cols.end(), byKey);
+        }
+    }
+
+    //the blocks which may turn out alike (the stages of identical instances, the single unknowns): those with
+    //the same pattern in their diagonal block. A block is only compared with its group when factorizing
+    std::vector<int> localCol(size, -1);
+    std::vector<std::vector<std::pair<unsigned, unsigned>>> blockPatterns(blocks.size());
+    for (size_t k = 0; k < blocks.size(); k++) {
+        const auto& block = blocks[k];
+        for (size_t j = 0; j < block.cols.size(); j++) localCol[block.cols[j]] = int(j);
+        for (size_t i = 0; i < block.rows.size(); i++) {
+            for (auto col : pattern[block.rows[i]]) {
+                if (localCol[col] >= 0) blockPatterns[k].emplace_back(unsigned(i), unsigned(localCol[col]));
+            }
+        }
+        std::sort(blockPatterns[k].begin(), blockPatterns[k].end());
+        for (auto col : block.cols) localCol[col] = -1;
+    }
+
+    //entries outside the diagonal block can only point to the unknowns of earlier blocks. The pattern of the
+    //couplings is set here, once; factorize only refills their values
+    std::vector<int> owner(size, -1);
+    std::vector<Eigen::Triplet<double>> entries;
+
+    factorizations.resize(blocks.size());
+    for (size_t k = 0; k < blocks.size(); k++) {
+        auto& block = blocks[k];
+        const auto blockSize = block.rows.size();
+        solveCost += double(blockSize) * blockSize;
+        factorizations[k] = Eigen::PartialPivLU<Eigen::MatrixXd>(blockSize);
+        block.diagonal.resize(blockSize, blockSize);
+        block.factorization = k;
+        block.rhs.resize(blockSize);
+        block.solution.resize(blockSize);
+
+        block.group = groups.size();
+        for (size_t g = 0; g < groups.size(); g++) {
+            const auto leader = groups[g].front();
+            if (blocks[leader].rows.size() == blockSize && blockPatterns[leader] == blockPatterns[k]) {
+                block.group = g;
+                break;
+            }
+        }
+        if (block.group == groups.size()) groups.emplace_back();
+        groups[block.group].push_back(k);
+
+        for (auto col : block.cols) owner[col] = int(k);
+        entries.clear();
+        for (size_t i = 0; i < blockSize; i++) {
+            for (auto col : pattern[block.rows[i]]) {
+                if (owner[col] >= 0 && owner[col] < int(k)) entries.emplace_back(int(i), int(col), 0.0);
+            }
+        }
+        block.coupling.resize(blockSize, size);
+        block.coupling.setFromTriplets(entries.begin(), entries.end());
+        block.coupling.makeCompressed();
+    }
+    return true;
+}
+
+
+void BlockSolver::factorize(const Eigen::Ref<const Eigen::MatrixXd>& matrix) {
+    for (size_t k = 0; k < blocks.size(); k++) {
+        auto& block = blocks[k];
+        const auto blockSize = block.rows.size();
+
+        for (size_t i = 0; i < blockSize; i++)
+            for (size_t j = 0; j < blockSize; j++)
+                block.diagonal(i, j) = matrix(block.rows[i], block.cols[j]);
+
+        //reuse the factorization of an earlier block of its group with the same matrix
+        block.factorization = k;
+        for (auto j : groups[block.group]) {
+            if (j == k) break;
+            if (blocks[j].factorization == j && blocks[j].diagonal == block.diagonal) {
+                block.factorization = j;
+                break;
+            }
+        }
+        if (block.factorization == k) factorizations[k].compute(block.diagonal);
+
+        const auto* outer = block.coupling.outerIndexPtr();
+        const auto* inner = block.coupling.innerIndexPtr();
+        auto* values = block.coupling.valuePtr();
+        for (size_t i = 0; i < blockSize; i++) {
+            for (auto p = outer[i]; p < outer[i + 1]; p++) values[p] = matrix(block.rows[i], inner[p]);
+        }
+    }
+}
+
+
+void BlockSolver::solve(const Eigen::Ref<const Eigen::VectorXd>& rhs, Eigen::Ref<Eigen::VectorXd> solution) {
+    for (auto& block : blocks) {
+        for (size_t i = 0; i < block.rows.size(); i++) block.rhs(i) = rhs(block.rows[i]);
+        if (block.coupling.nonZeros() > 0) block.rhs.noalias() -= block.coupling * solution;
+
+        block.solution.noalias() = factorizations[block.factorization].solve(block.rhs);
+        for (size_t i = 0; i < block.cols.size(); i++) solution(block.cols[i]) = block.solution(i);
+    }
+}
+
+
+size_t BlockSolver::getNumFactorizations() const {
+    size_t count = 0;
+    for (size_t k = 0; k < blocks.size(); k++) {
+        if (blocks[k].factorization == k) count++;
+    }
+    return count;
+}
+
+
+void BlockSolver::clear() {
+    blocks.clear();
+    factorizations.clear();
+    groups.clear();
+    size = 0;
+    solveCost = 0;
+}
@@ -0,0 +1,55 @@
+/*
+  ==============================================================================
+
+    blockSolver.h
+    Created: 19 Oct 2026 2:47:18pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
+
+// Solver for the reduced MNA matrix split into its strongly connected blocks.
+// Rows and columns are permuted to a block triangular form (maximum transversal, then
+// Tarjan's algorithm on the dependency graph), so that stages which only feed each other
+// one way - like the stages separated by a buffer op-amp - and disconnected parts of the
+// circuit are factorized and solved as a chain of smaller systems.
+// Blocks with identical diagonal matrices (the stages of identical subcircuit instances)
+// share a single factorization.
+class BlockSolver {
+public:
+    // pattern[i] lists the columns of the non-zero entries of row i. Rows and columns of a block are
+    // sorted by their key when keys are given, so that the blocks of identical stages come out alike
+    bool analyse(const std::vector<std::vector<unsigned>>& pattern, const std::vector<size_t>& keys = {});
+    void factorize(const Eigen::Ref<const Eigen::MatrixXd>& matrix);
+    void solve(const Eigen::Ref<const Eigen::VectorXd>& rhs, Eigen::Ref<Eigen::VectorXd> solution);
+    void clear();
+
+    bool isActive() const { return blocks.size() > 1; }
+    size_t getNumBlocks() const { return blocks.size(); }
+    size_t getNumFactorizations() const;
+    double getSolveCost() const { return solveCost; }
+
+private:
+    struct Block {
+        std::vector<unsigned> rows;                             // equations of the block
+        std::vector<unsigned> cols;                             // unknowns of the block
+        Eigen::MatrixXd diagonal;
+        size_t factorization;                                   // index of its LU in factorizations
+        size_t group;                                           // index in groups
+        Eigen::SparseMatrix<double, Eigen::RowMajor> coupling;  // dependence on the unknowns of the previous blocks
+        Eigen::VectorXd rhs, solution;
+    };
+
+    bool findTransversal(const std::vector<std::vector<unsigned>>& pattern, std::vector<int>& rowToCol);
+
+    std::vector<Block> blocks;
+    std::vector<Eigen::PartialPivLU<Eigen::MatrixXd>> factorizations;
+    std::vector<std::vector<size_t>> groups;    // blocks which may share a factorization, in order
+    unsigned size = 0;
+    double solveCost = 0;   // multiply-adds per solve: the diagonal blocks, plus the couplings
+};
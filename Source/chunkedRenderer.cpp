@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    chunkedRenderer.cpp
+    Created: 20 Oct 2026 3:26:10pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "chunkedRenderer.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+
+ChunkedRenderer::ChunkedRenderer(const std::string& netlistText)
+    : netlistText(netlistText) {}
+
+
+unsigned ChunkedRenderer::getNumThreads() const {
+    return numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+// Render samples [start, start + length) of input to output, by blocks. Returns false if stopped
+bool ChunkedRenderer::renderChunk(Netlist& netlist, const float* const* input, float* const* output, int numChannels,
+                                  int start, int length) const {
+    for (int channel = 0; channel < numChannels && input != output; channel++) {
+        std::copy(input[channel] + start, input[channel] + start + length, output[channel] + start);
+    }
+    for (int position = start; position < start + length; position += blockSize) {
+        if (shouldStop != nullptr && *shouldStop) return false;
+        const int count = std::min(blockSize, start + length - position);
+        juce::dsp::AudioBlock<float> block(output, size_t(numChannels), size_t(position), size_t(count));
+        netlist.processBlock(block);
+    }
+    return true;
+}
+
+
+// Largest difference between the states of two snapshots, relative to the largest value of lhs: x, xPrev and b of
+// each channel, and the sources of the reactive components they lead to at the next sample. The sources stored in
+// the snapshots are left out, since they only hold the last channel processed, and only by the per-sample solves.
+// Restores both in netlist, which is left in the state of lhs
+double ChunkedRenderer::getStateDistance(Netlist& netlist, const std::vector<char>& lhs, const std::vector<char>& rhs) const {
+    auto getValues = [&netlist](const std::vector<char>& snapshot) {
+        netlist.restoreState(snapshot.data(), snapshot.size());
+        std::vector<double> values;
+        for (size_t channel = 0; channel < netlist.channelXStates.size(); channel++) {
+            for (const auto* vector : { &netlist.channelXStates[channel], &netlist.channelXPrevStates[channel], &netlist.channelBStates[channel] }) {
+                values.insert(values.end(), vector->data(), vector->data() + vector->size());
+            }
+            netlist.loadChannelState(int(channel));
+            for (const auto& comp : netlist.reactiveComponents) {
+                comp->updateVoltage(netlist, netlist.integrationStages[0]);
+                values.push_back(comp->voltage);
+            }
+        }
+        return values;
+    };
+
+    const auto rhsValues = getValues(rhs);
+    const auto lhsValues = getValues(lhs);
+    double distance = 0, scale = 0;
+    for (size_t k = 0; k < lhsValues.size(); k++) {
+        distance = std::max(distance, std::abs(lhsValues[k] - rhsValues[k]));
+        scale = std::max(scale, std::abs(lhsValues[k]));
+    }
+    return distance / std::max(scale, 1e-12);
+}
+
+
+int ChunkedRenderer::render(const float* const* input, float* const* output, int numChannels, int numSamples) {
+    if (numSamples <= 0) return 0;
+
+    const int numChunks = std::clamp(numSamples / std::max(minChunkSamples, 1), 1, int(getNumThreads()));
+    const int chunkSize = (numSamples + numChunks - 1) / numChunks;
+
+    std::vector<std::unique_ptr<Netlist>> netlists(numChunks);
+    std::vector<std::vector<char>> startStates(numChunks), endStates(numChunks);
+    std::vector<std::string> errors(numChunks);
+    std::atomic<bool> stopped{ false };
+
+    //runs task for each of the chunks, the first one on this thread
+    auto runInParallel = [&](const std::vector<int>& chunks, auto task) {
+        auto run = [&](int chunk) {
+            try {
+                if (!task(chunk)) stopped = true;
+            }
+            catch (const std::exception& e) {
+                errors[chunk] = e.what();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t k = 1; k < chunks.size(); k++) threads.emplace_back(run, chunks[k]);
+        if (!chunks.empty()) run(chunks[0]);
+        for (auto& thread : threads) thread.join();
+
+        for (const auto& error : errors) {
+            if (!error.empty()) throw std::runtime_error(error);
+        }
+    };
+
+    //first pass: each chunk after a pre-roll, on a copy of the input preceding it
+    std::vector<int> chunks(numChunks);
+    for (int chunk = 0; chunk < numChunks; chunk++) chunks[chunk] = chunk;
+    runInParallel(chunks, [&](int chunk) {
+        auto& netlist = netlists[chunk];
+        netlist = settings.createNetlist(netlistText, numChannels);
+
+        const int start = chunk * chunkSize;
+        const int preRoll = std::min(preRollSamples, start);
+        if (preRoll > 0) {
+            std::vector<std::vector<float>> scratch(numChannels);
+            std::vector<float*> pointers(numChannels);
+            for (int channel = 0; channel < numChannels; channel++) {
+                scratch[channel].assign(input[channel] + start - preRoll, input[channel] + start);
+                pointers[channel] = scratch[channel].data();
+            }
+            if (!renderChunk(*netlist, pointers.data(), pointers.data(), numChannels, 0, preRoll)) return false;
+        }
+
+        startStates[chunk] = netlist->saveState();
+        if (!renderChunk(*netlist, input, output, numChannels, start, std::min(chunkSize, numSamples - start))) return false;
+        endStates[chunk] = netlist->saveState();
+        return true;
+    });
+    if (stopped) return -1;
+
+    //handoff passes: the chunks whose start doesn't match the end of the previous one are rendered again from it
+    auto comparison = settings.createNetlist(netlistText, numChannels);
+    int numPasses = 0;
+    for (int firstInexact = 1;; numPasses++) {
+        chunks.clear();
+        for (int chunk = firstInexact; chunk < numChunks; chunk++) {
+            if (getStateDistance(*comparison, endStates[chunk - 1], startStates[chunk]) <= tolerance) {
+                if (chunk == firstInexact) firstInexact++;
+            }
+            else {
+                chunks.push_back(chunk);
+            }
+        }
+        if (chunks.empty()) break;
+
+        //from the end states of this pass, the chunks rendered in it updating theirs
+        const auto previousEndStates = endStates;
+        runInParallel(chunks, [&](int chunk) {
+            auto& netlist = *netlists[chunk];
+            startStates[chunk] = previousEndStates[chunk - 1];
+            netlist.restoreState(startStates[chunk].data(), startStates[chunk].size());
+
+            const int start = chunk * chunkSize;
+            if (!renderChunk(netlist, input, output, numChannels, start, std::min(chunkSize, numSamples - start))) return false;
+            endStates[chunk] = netlist.saveState();
+            return true;
+        });
+        if (stopped) return -1;
+    }
+    return numPasses;
+}
+
+
+bool ChunkedRenderer::canRender(const juce::File& inputFile) const {
+    if (getNumThreads() < 2) return false;
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+    if (reader == nullptr || reader->lengthInSamples > std::numeric_limits<int>::max()) return false;
+
+    //the input and the output, decoded as floats
+    return 2 * sizeof(float) * size_t(reader->numChannels) * size_t(reader->lengthInSamples) <= maxMemoryBytes;
+}
+
+
+bool ChunkedRenderer::render(const juce::File& inputFile, const juce::File& outputFile) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+    if (reader == nullptr) throw std::runtime_error("Unable to read " + inputFile.getFullPathName().toStdString());
+
+    const int numChannels = int(reader->numChannels);
+    const int numSamples = int(reader->lengthInSamples);
+    juce::AudioBuffer<float> input(numChannels, numSamples), output(numChannels, numSamples);
+    reader->read(&input, 0, numSamples, 0, true, true);
+
+    settings.sampleRate = reader->sampleRate;
+    if (render(input.getArrayOfReadPointers(), output.getArrayOfWritePointers(), numChannels, numSamples) < 0) return false;
+
+    auto* outputFormat = formatManager.findFormatForFileExtension(outputFile.getFileExtension());
+    if (outputFormat == nullptr) outputFormat = formatManager.findFormatForFileExtension("wav");
+    outputFile.deleteFile();
+    auto outputStream = outputFile.createOutputStream();
+    if (outputStream == nullptr) throw std::runtime_error("Unable to write " + outputFile.getFullPathName().toStdString());
+    std::unique_ptr<juce::AudioFormatWriter> writer(outputFormat->createWriterFor(outputStream.get(), reader->sampleRate,
+        unsigned(numChannels), outputBitsPerSample, {}, 0));
+    if (writer == nullptr) throw std::runtime_error("Unsupported output format for " + outputFile.getFullPathName().toStdString());
+    outputStream.release();     //owned by the writer from now on
+
+    const bool written = writer->writeFromAudioSampleBuffer(output, 0, numSamples);
+    writer.reset();     //flushes and closes the file
+    if (!written) throw std::runtime_error("Error while writing " + outputFile.getFullPathName().toStdString());
+    return true;
+}
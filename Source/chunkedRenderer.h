@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    chunkedRenderer.h
+    Created: 20 Oct 2026 3:26:10pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "renderSettings.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Offline rendering of a signal held in memory, split in chunks rendered in parallel, one thread per chunk.
+// Each chunk has its own copy of the netlist, which approximates the state at the start of the chunk by running
+// the preRollSamples before it from the DC operating point. The chunks are then handed over in passes: the
+// whole state a chunk started from (x, xPrev and b of each channel, and the sources of the reactive components,
+// see Netlist::saveState) is compared to the one the previous chunk ended in, and every chunk where they differ
+// beyond tolerance is rendered again, in parallel, from the state the previous chunk ended in. A chunk is exact
+// once the previous one is and they match, so each pass makes at least one more chunk exact, and the output then
+// matches a single-threaded render. Dissipative circuits forget their initial state within the pre-roll, or at
+// worst within a chunk, so they need no more than one or two passes.
+// The fixed step strategies are used, since their whole state is in the netlist snapshots
+class ChunkedRenderer {
+public:
+    explicit ChunkedRenderer(const std::string& netlistText);
+
+    // Whether inputFile can be rendered here: it must be readable, fit in maxMemoryBytes once decoded, and
+    // there must be more than one thread to render it with (StreamingRenderer is used otherwise)
+    bool canRender(const juce::File& inputFile) const;
+
+    // Same contract as StreamingRenderer::render: throws if the input can't be read, the output can't be written
+    // or the netlist can't be loaded, and returns false, without leaving an output file, if shouldStop was set
+    bool render(const juce::File& inputFile, const juce::File& outputFile);
+
+    // Renders numSamples of each channel from input to output (which may not overlap). Returns the number of
+    // handoff passes (0 when every chunk started from the state the previous one ended in), or -1 if shouldStop
+    // was set. Throws if the netlist can't be loaded
+    int render(const float* const* input, float* const* output, int numChannels, int numSamples);
+
+    RenderSettings settings;
+    unsigned numThreads = 0;            // 0 for the number of hardware threads
+    int preRollSamples = 9600;
+    int minChunkSamples = 48000;        // shorter signals are split in fewer chunks
+    int blockSize = 8192;               // processed at once, shouldStop being checked between blocks
+    double tolerance = 1e-7;            // on the state, relative to its largest value
+    size_t maxMemoryBytes = size_t(1) << 30;    // for the decoded input and output
+    int outputBitsPerSample = 24;
+    const std::atomic<bool>* shouldStop = nullptr;
+
+private:
+    unsigned getNumThreads() const;
+    bool renderChunk(Netlist& netlist, const float* const* input, float* const* output, int numChannels, int start, int length) const;
+    double getStateDistance(Netlist& netlist, const std::vector<char>& lhs, const std::vector<char>& rhs) const;
+
+    std::string netlistText;
+};
@@ -2,10 +2,20 @@
 #pragma once
 #include "component.h"
 #include "netlist.h"
+#include <algorithm>
+#include <stdexcept>
 
 Component::Component(unsigned start_node, unsigned end_node, double value)
     : start_node(start_node), end_node(end_node), value(value) {}
 
+std::vector<unsigned*> Component::getTerminals() {
+    return { &start_node, &end_node };
+}
+
+void Component::setParameter(const std::string& name, double) {
+    throw std::runtime_error("Unknown parameter: " + name);
+}
+
 
 Resistance::Resistance(unsigned start_node, unsigned end_node, double value)
     : Component(start_node, end_node, value), admittance(1.0 / value) {}
@@ -18,6 +28,18 @@ void Resistance::stamp(Netlist& netlist) const {
 }
 
 
+Potentiometer::Potentiometer(unsigned start_node, unsigned end_node, double value, unsigned knob)
+    : Resistance(start_node, end_node, value), knob(knob), position(0.5), minValue(1.0) {
+    setPosition(position);
+}
+
+void Potentiometer::setPosition(double newPosition) {
+    //linear taper, the residual resistance keeps the matrix regular when the knob is at 0
+    position = std::clamp(newPosition, 0.0, 1.0);
+    admittance = 1.0 / (minValue + position * value);
+}
+
+
 // ReactiveComponent class methods
 ReactiveComponent::ReactiveComponent(unsigned start_node, unsigned end_node, double value, unsigned index)
     : Component(start_node, end_node, value), index(index), resistance(0), voltage(0) {}
@@ -39,24 +61,37 @@ void ReactiveComponent::stamp(Netlist& netlist) const {
 Capacitor::Capacitor(unsigned start_node, unsigned end_node, double value, unsigned index)
     : ReactiveComponent(start_node, end_node, value, index) {}
 
-void Capacitor::setResistance(double Ts) {
-    resistance = Ts / (2 * value);
+// state: voltage across the capacitor, derivative: current / C
+void Capacitor::setResistance(double Ts, const IntegrationStage& stage) {
+    resistance = stage.beta0 * Ts / value;
 }
 
-void Capacitor::updateVoltage(Netlist& netlist) {
-    voltage = (netlist.x(start_node) - netlist.x(end_node)) + resistance * netlist.x(netlist.n + index);
+void Capacitor::updateVoltage(Netlist& netlist, const IntegrationStage& stage) {
+    const auto& x = netlist.x;
+    const auto& xPrev = netlist.xPrev;
+    const unsigned n = netlist.n;
+
+    voltage = stage.a1 * (x(start_node) - x(end_node))
+            + stage.a2 * (xPrev(start_node) - xPrev(end_node))
+            + (stage.beta1 / stage.beta0) * resistance * x(n + index);
 }
 
 
 Inductance::Inductance(unsigned start_node, unsigned end_node, double value, unsigned index)
     : ReactiveComponent(start_node, end_node, value, index) {}
 
-void Inductance::setResistance(double Ts) {
-    resistance = (2 * value) / Ts;
+// state: current through the inductance, derivative: voltage / L
+void Inductance::setResistance(double Ts, const IntegrationStage& stage) {
+    resistance = value / (stage.beta0 * Ts);
 }
 
-void Inductance::updateVoltage(Netlist& netlist) {
-    voltage = -((netlist.x(start_node) - netlist.x(end_node)) + resistance * netlist.x(netlist.n + index));
+void Inductance::updateVoltage(Netlist& netlist, const IntegrationStage& stage) {
+    const auto& x = netlist.x;
+    const auto& xPrev = netlist.xPrev;
+    const unsigned n = netlist.n;
+
+    voltage = -(resistance * (stage.a1 * x(n + index) + stage.a2 * xPrev(n + index))
+            + (stage.beta1 / stage.beta0) * (x(start_node) - x(end_node)));
 }
 
 
@@ -101,6 +136,10 @@ void IdealOPA::stamp(Netlist& netlist) const {
     netlist.A(n + index, end_node) = -1;
 }
 
+std::vector<unsigned*> IdealOPA::getTerminals() {
+    return { &start_node, &end_node, &output_node };
+}
+
 VoltageProbe::VoltageProbe(unsigned start_node, unsigned end_node)
 	: Component(start_node, end_node, 0.0) {}
 
@@ -117,6 +156,8 @@ Diode::Diode(unsigned start_node, unsigned end_node)
     N = 1.6;	   //ideality factor
     Is = 2.6e-6;   //reverse saturation current
 
+    Rs = 0;        //series resistance
+
     Vt = 0.025852;  //thermal voltage at approx. 300K 
     N_Vt = N * Vt;  //N*Vt
 
@@ -128,6 +169,15 @@ Diode::Diode(unsigned start_node, unsigned end_node)
 }
 
 
+void Diode::setParameter(const std::string& name, double parameterValue) {
+    if (name == "is")        Is = parameterValue;
+    else if (name == "n")    N = parameterValue;
+    else if (name == "rs")   Rs = parameterValue;
+    else if (name == "temp") Vt = 8.617333262e-5 * (parameterValue + 273.15);  //temperature in celsius
+    else Component::setParameter(name, parameterValue);
+    N_Vt = N * Vt;
+}
+
 void Diode::stamp(Netlist& netlist) const {
     unsigned n = netlist.n;
 
@@ -141,18 +191,116 @@ void Diode::stamp(Netlist& netlist) const {
 
 }
 
-void Diode::update_voltage(Netlist& netlist) {
-    voltage = netlist.x(start_node) - netlist.x(end_node);
+
+BJT::BJT(unsigned collector, unsigned base, unsigned emitter, double polarity)
+    : Component(collector, emitter, 0.0), base_node(base), polarity(polarity) {
+
+    //default parameters based on the 2N3904
+    Is = 6.734e-15;
+    Vt = 0.025852;
+    betaF = 416.4;
+    betaR = 0.7371;
+
+    vbe = vbc = 0;
+    Ic = Ib = 0;
+    gcbe = gcbc = gbbe = gbbc = 0;
+}
+
+void BJT::setParameter(const std::string& name, double parameterValue) {
+    if (name == "is")      Is = parameterValue;
+    else if (name == "bf") betaF = parameterValue;
+    else if (name == "br") betaR = parameterValue;
+    else Component::setParameter(name, parameterValue);
+}
+
+void BJT::stamp(Netlist& netlist) const {
+    const unsigned c = start_node, b = base_node, e = end_node;
+    auto& A = netlist.A;
+
+    //equivalent currents of the linearization, back in the polarity of the transistor
+    const double Ieq_c = polarity * (Ic - gcbe * vbe - gcbc * vbc);
+    const double Ieq_b = polarity * (Ib - gbbe * vbe - gbbc * vbc);
+
+    A(c, b) += gcbe + gcbc;
+    A(c, e) -= gcbe;
+    A(c, c) -= gcbc;
+    netlist.b(c) -= Ieq_c;
+
+    A(b, b) += gbbe + gbbc;
+    A(b, e) -= gbbe;
+    A(b, c) -= gbbc;
+    netlist.b(b) -= Ieq_b;
+
+    A(e, b) -= gcbe + gcbc + gbbe + gbbc;
+    A(e, e) += gcbe + gbbe;
+    A(e, c) += gcbc + gbbc;
+    netlist.b(e) += Ieq_c + Ieq_b;
+}
+
+std::vector<unsigned*> BJT::getTerminals() {
+    return { &start_node, &base_node, &end_node };
+}
+
+
+JFET::JFET(unsigned drain, unsigned gate, unsigned source, double polarity)
+    : Component(drain, source, 0.0), gate_node(gate), polarity(polarity) {
+
+    //default parameters based on the J201
+    Vto = -0.8;
+    beta = 1.304e-3;
+    lambda = 4e-3;
+
+    vgs = vds = 0;
+    Id = 0;
+    gm = gds = 0;
+}
+
+void JFET::setParameter(const std::string& name, double parameterValue) {
+    if (name == "vto")         Vto = parameterValue;
+    else if (name == "beta")   beta = parameterValue;
+    else if (name == "lambda") lambda = parameterValue;
+    else Component::setParameter(name, parameterValue);
 }
 
-void Diode::update_Id(Netlist& netlist) {
-    Id = Is * std::expm1(voltage / N_Vt); //Id = Is * (std::exp(voltage / N_Vt) - 1);
+void JFET::stamp(Netlist& netlist) const {
+    const unsigned d = start_node, g = gate_node, s = end_node;
+    auto& A = netlist.A;
+
+    const double Ieq = polarity * (Id - gm * vgs - gds * vds);
+
+    A(d, g) += gm;
+    A(d, d) += gds;
+    A(d, s) -= gm + gds;
+    netlist.b(d) -= Ieq;
+
+    A(s, g) -= gm;
+    A(s, d) -= gds;
+    A(s, s) += gm + gds;
+    netlist.b(s) += Ieq;
 }
 
-void Diode::update_Geq(Netlist& netlist) {
-    Geq = (Is / N_Vt) * std::exp(voltage / N_Vt);
+std::vector<unsigned*> JFET::getTerminals() {
+    return { &start_node, &gate_node, &end_node };
+}
+
+
+TanhVCCS::TanhVCCS(unsigned start_node, unsigned end_node, unsigned control_pos, unsigned control_neg, double gm, double Imax)
+    : Component(start_node, end_node, gm), control_pos(control_pos), control_neg(control_neg), gm(gm), Imax(Imax),
+      voltage(0), current(0), conductance(gm) {}
+
+void TanhVCCS::stamp(Netlist& netlist) const {
+    auto& A = netlist.A;
+    const double Ieq = current - conductance * voltage;
+
+    A(start_node, control_pos) += conductance;
+    A(start_node, control_neg) -= conductance;
+    netlist.b(start_node) -= Ieq;
+
+    A(end_node, control_pos) -= conductance;
+    A(end_node, control_neg) += conductance;
+    netlist.b(end_node) += Ieq;
 }
 
-void Diode::update_Ieq(Netlist& netlist) {
-    Ieq = Id - Geq * voltage;
-}
\ No newline at end of file
+std::vector<unsigned*> TanhVCCS::getTerminals() {
+    return { &start_node, &end_node, &control_pos, &control_neg };
+}
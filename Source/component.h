@@ -4,6 +4,20 @@
 //Forward declaration of Netlist class to avoid circular dependencies
 class Netlist;
 
+// One step of a linear multistep integration formula, for a state s with derivative k.r:
+// s = h.k.(beta0.r + beta1.r[-1]) + a1.s[-1] + a2.s[-2]
+// where [-1] and [-2] are the two previous solutions of the system, and h the sample period.
+// timeFraction is the point of the sample period the step ends at (composite formulas).
+struct IntegrationStage {
+    double beta0, beta1, a1, a2;
+    double timeFraction;
+};
+
+enum class IntegrationMethod { BackwardEuler, Trapezoidal, DampedTrapezoidal, BDF2, TRBDF2 };
+
+#include <string>
+#include <vector>
+
 class Component {
 public:
     unsigned start_node, end_node;
@@ -13,6 +27,15 @@ public:
     virtual ~Component() = default;
 
     virtual void stamp(Netlist& netlist) const = 0;
+
+    // Nodes the component is connected to (start_node and end_node, plus any other terminal)
+    virtual std::vector<unsigned*> getTerminals();
+    // Nonlinear components are linearized around the last solution at each Newton iteration,
+    // and couple all their terminals together in A
+    virtual bool isNonlinear() const { return false; }
+    // Named parameter from the netlist or from a .model card (name in lower case).
+    // Throws for a parameter the component doesn't have
+    virtual void setParameter(const std::string& name, double parameterValue);
 };
 
 class Resistance : public Component {
@@ -23,6 +46,16 @@ public:
     virtual void stamp(Netlist& netlist) const override;
 };
 
+class Potentiometer : public Resistance {
+public:
+    unsigned knob;      // index of the plugin knob driving this element
+    double position;    // normalised knob position in [0, 1]
+    double minValue;    // residual resistance when the knob is fully turned down
+
+    Potentiometer(unsigned start_node, unsigned end_node, double value, unsigned knob);
+    void setPosition(double newPosition);
+};
+
 class ReactiveComponent : public Component {
 public:
     unsigned index;
@@ -30,23 +63,24 @@ public:
     double voltage;
 
     ReactiveComponent(unsigned start_node, unsigned end_node, double value, unsigned index);
-    virtual void setResistance(double Ts) = 0;
-    virtual void updateVoltage(Netlist& netlist) = 0;
+    virtual void setResistance(double Ts, const IntegrationStage& stage) = 0;
+    virtual void updateVoltage(Netlist& netlist, const IntegrationStage& stage) = 0;
     virtual void stamp(Netlist& netlist) const override;
 };
 
+// Both companion models are v = resistance.i + voltage, i being the branch current
 class Capacitor : public ReactiveComponent {
 public:
     Capacitor(unsigned start_node, unsigned end_node, double value, unsigned index);
-    virtual void setResistance(double Ts) override;
-    virtual void updateVoltage(Netlist& netlist) override;
+    virtual void setResistance(double Ts, const IntegrationStage& stage) override;
+    virtual void updateVoltage(Netlist& netlist, const IntegrationStage& stage) override;
 };
 
 class Inductance : public ReactiveComponent {
 public:
     Inductance(unsigned start_node, unsigned end_node, double value, unsigned index);
-    virtual void setResistance(double Ts) override;
-    virtual void updateVoltage(Netlist& netlist) override;
+    virtual void setResistance(double Ts, const IntegrationStage& stage) override;
+    virtual void updateVoltage(Netlist& netlist, const IntegrationStage& stage) override;
 };
 
 class VoltageSource : public Component {
@@ -79,6 +113,7 @@ public:
 
     IdealOPA(unsigned start_node, unsigned end_node, unsigned output_node, unsigned index);
     virtual void stamp(Netlist& netlist) const override;
+    virtual std::vector<unsigned*> getTerminals() override;
 };
 
 class VoltageProbe : public Component {
@@ -92,20 +127,20 @@ public:
 };
 
 
+// Shockley diode, with an optional series resistance (added as a separate resistor at load time).
+// The model is evaluated by DeviceBank, for all the diodes of the netlist at once
 class Diode : public Component {
 public:
     Diode(unsigned start_node, unsigned end_node);
 
     virtual void stamp(Netlist& netlist) const override;
-
-    void update_voltage(Netlist& netlist);
-    void update_Id(Netlist& netlist);
-    void update_Geq(Netlist& netlist);
-    void update_Ieq(Netlist& netlist);
+    virtual void setParameter(const std::string& name, double parameterValue) override;
+    virtual bool isNonlinear() const override { return true; }
 
     double Vt;      //thermal voltage
     double N;       //emission coefficient of the diode
     double Is;      //saturation current
+    double Rs;      //series resistance
     double N_Vt;    //N*Vt
 
     double Id;      //current through the diode
@@ -115,3 +150,75 @@ public:
     double Geq;	    //equivalent conductance
 
 };
+
+
+// Ebers-Moll (transport) model of a bipolar transistor.
+// start_node is the collector, end_node the emitter. The model is evaluated by DeviceBank,
+// for all the transistors of the netlist at once
+class BJT : public Component {
+public:
+    BJT(unsigned collector, unsigned base, unsigned emitter, double polarity);
+
+    virtual void stamp(Netlist& netlist) const override;
+    virtual void setParameter(const std::string& name, double parameterValue) override;
+    virtual std::vector<unsigned*> getTerminals() override;
+    virtual bool isNonlinear() const override { return true; }
+
+    unsigned base_node;
+    double polarity;    // 1 for NPN, -1 for PNP
+
+    double Is;          //saturation current
+    double Vt;          //thermal voltage
+    double betaF;       //forward current gain
+    double betaR;       //reverse current gain
+
+    // Linearization at the last Newton iteration, in NPN convention
+    double vbe, vbc;                    // junction voltages (after limiting)
+    double Ic, Ib;                      // currents entering the collector and the base
+    double gcbe, gcbc, gbbe, gbbc;      // derivatives of Ic and Ib with respect to vbe and vbc
+};
+
+
+// Shichman-Hodges model of a junction FET (gate current neglected).
+// start_node is the drain, end_node the source
+class JFET : public Component {
+public:
+    JFET(unsigned drain, unsigned gate, unsigned source, double polarity);
+
+    virtual void stamp(Netlist& netlist) const override;
+    virtual void setParameter(const std::string& name, double parameterValue) override;
+    virtual std::vector<unsigned*> getTerminals() override;
+    virtual bool isNonlinear() const override { return true; }
+
+    unsigned gate_node;
+    double polarity;    // 1 for N channel, -1 for P channel
+
+    double Vto;         //pinch-off voltage
+    double beta;        //transconductance parameter
+    double lambda;      //channel-length modulation
+
+    // Linearization at the last Newton iteration, in N channel convention
+    double vgs, vds;
+    double Id;          // current entering the drain
+    double gm, gds;     // derivatives of Id with respect to vgs and vds
+};
+
+
+// Voltage controlled current source with a tanh saturation: i = Imax.tanh(gm.v / Imax), v being
+// the voltage between the control nodes. The current flows from start_node to end_node through
+// the source. Used by the op-amp macromodel for its slew-limited input stage and its output rails
+class TanhVCCS : public Component {
+public:
+    TanhVCCS(unsigned start_node, unsigned end_node, unsigned control_pos, unsigned control_neg, double gm, double Imax);
+
+    virtual void stamp(Netlist& netlist) const override;
+    virtual std::vector<unsigned*> getTerminals() override;
+    virtual bool isNonlinear() const override { return true; }
+
+    unsigned control_pos, control_neg;
+    double gm, Imax;
+
+    double voltage;     // control voltage of the last Newton iteration
+    double current;
+    double conductance; // derivative of the current with respect to the control voltage
+};
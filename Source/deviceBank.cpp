@@ -0,0 +1,216 @@
+/*
+  ==============================================================================
+
+    deviceBank.cpp
+    Created: 19 Oct 2026 11:38:45pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "deviceBank.h"
+#include "component.h"
+#include <cmath>
+
+
+void DeviceBank::build(const std::vector<std::shared_ptr<Component>>& components) {
+    clear();
+    for (const auto& comp : components) {
+        if (auto diode = std::dynamic_pointer_cast<Diode>(comp))        diodes.push_back(diode);
+        else if (auto bjt = std::dynamic_pointer_cast<BJT>(comp))       bjts.push_back(bjt);
+        else if (auto jfet = std::dynamic_pointer_cast<JFET>(comp))     jfets.push_back(jfet);
+        else if (auto vccs = std::dynamic_pointer_cast<TanhVCCS>(comp)) tanhSources.push_back(vccs);
+    }
+
+    const auto nd = Eigen::Index(diodes.size());
+    diodeAnode.resize(nd); diodeCathode.resize(nd);
+    diodeIs.resize(nd); diodeInvNVt.resize(nd); diodeIsOverNVt.resize(nd);
+    for (Eigen::Index k = 0; k < nd; k++) {
+        const auto& diode = *diodes[k];
+        diodeAnode[k] = diode.start_node;
+        diodeCathode[k] = diode.end_node;
+        diodeIs(k) = diode.Is;
+        diodeInvNVt(k) = 1.0 / diode.N_Vt;
+        diodeIsOverNVt(k) = diode.Is / diode.N_Vt;
+    }
+    diodeVoltage.resize(nd); diodeExpV.resize(nd);
+
+    const auto nb = Eigen::Index(bjts.size());
+    bjtPolarity.resize(nb); bjtIs.resize(nb); bjtVt.resize(nb);
+    bjtInvBetaF.resize(nb); bjtInvBetaR.resize(nb);
+    for (Eigen::Index k = 0; k < nb; k++) {
+        const auto& bjt = *bjts[k];
+        bjtPolarity(k) = bjt.polarity;
+        bjtIs(k) = bjt.Is;
+        bjtVt(k) = bjt.Vt;
+        bjtInvBetaF(k) = 1.0 / bjt.betaF;
+        bjtInvBetaR(k) = 1.0 / bjt.betaR;
+    }
+    //critical voltage of the junction limiting (SPICE's pnjlim)
+    bjtVcrit = bjtVt * (bjtVt / (std::sqrt(2.0) * bjtIs)).log();
+    bjtVbe = Eigen::ArrayXd::Zero(nb);
+    bjtVbc = Eigen::ArrayXd::Zero(nb);
+    bjtVbeNew.resize(nb); bjtVbcNew.resize(nb); bjtExpF.resize(nb); bjtExpR.resize(nb);
+
+    const auto nj = Eigen::Index(jfets.size());
+    jfetPolarity.resize(nj); jfetVto.resize(nj); jfetBeta.resize(nj); jfetLambda.resize(nj);
+    for (Eigen::Index k = 0; k < nj; k++) {
+        const auto& jfet = *jfets[k];
+        jfetPolarity(k) = jfet.polarity;
+        jfetVto(k) = jfet.Vto;
+        jfetBeta(k) = jfet.beta;
+        jfetLambda(k) = jfet.lambda;
+    }
+    jfetVgs.resize(nj); jfetVds.resize(nj); jfetId.resize(nj); jfetGm.resize(nj); jfetGds.resize(nj);
+
+    const auto nt = Eigen::Index(tanhSources.size());
+    tanhGm.resize(nt); tanhImax.resize(nt);
+    for (Eigen::Index k = 0; k < nt; k++) {
+        tanhGm(k) = tanhSources[k]->gm;
+        tanhImax(k) = tanhSources[k]->Imax;
+    }
+    tanhVoltage.resize(nt); tanhT.resize(nt);
+}
+
+
+void DeviceBank::clear() {
+    diodes.clear();
+    bjts.clear();
+    jfets.clear();
+    tanhSources.clear();
+}
+
+
+// Restart the junction limiting from the voltages at x, forgetting the iterations of a previous solve
+void DeviceBank::resetLimiting(const Eigen::VectorXd& x) {
+    for (Eigen::Index k = 0; k < Eigen::Index(bjts.size()); k++) {
+        const auto& bjt = *bjts[k];
+        bjtVbe(k) = bjtPolarity(k) * (x(bjt.base_node) - x(bjt.end_node));
+        bjtVbc(k) = bjtPolarity(k) * (x(bjt.base_node) - x(bjt.start_node));
+    }
+}
+
+
+void DeviceBank::evaluate(const Eigen::VectorXd& x) {
+    if (!diodes.empty())      evaluateDiodes(x);
+    if (!bjts.empty())        evaluateBJTs(x);
+    if (!jfets.empty())       evaluateJFETs(x);
+    if (!tanhSources.empty()) evaluateTanhSources(x);
+}
+
+
+// The evaluate functions write into the arrays sized by build: the element-wise expressions are evaluated
+// directly into them, without temporaries, so that a Newton iteration doesn't allocate
+void DeviceBank::evaluateDiodes(const Eigen::VectorXd& x) {
+    const auto nd = Eigen::Index(diodes.size());
+    for (Eigen::Index k = 0; k < nd; k++) diodeVoltage(k) = x(diodeAnode[k]) - x(diodeCathode[k]);
+
+    diodeExpV = (diodeVoltage * diodeInvNVt).exp();
+
+    for (Eigen::Index k = 0; k < nd; k++) {
+        auto& diode = *diodes[k];
+        diode.voltage = diodeVoltage(k);
+        diode.Id = diodeIs(k) * (diodeExpV(k) - 1.0);
+        diode.Geq = diodeIsOverNVt(k) * diodeExpV(k);
+        diode.Ieq = diode.Id - diode.Geq * diodeVoltage(k);
+    }
+}
+
+
+void DeviceBank::evaluateBJTs(const Eigen::VectorXd& x) {
+    const auto nb = Eigen::Index(bjts.size());
+    for (Eigen::Index k = 0; k < nb; k++) {
+        const auto& bjt = *bjts[k];
+        bjtVbeNew(k) = bjtPolarity(k) * (x(bjt.base_node) - x(bjt.end_node));
+        bjtVbcNew(k) = bjtPolarity(k) * (x(bjt.base_node) - x(bjt.start_node));
+    }
+
+    //limit the junction voltage steps, so that the exponentials can't blow up between two iterations
+    auto limit = [this](const Eigen::ArrayXd& vnew, Eigen::ArrayXd& vold) {
+        vold = ((vnew > bjtVcrit) && ((vnew - vold).abs() > 2.0 * bjtVt)).select(
+            (vold > 0).select(vold + bjtVt * (1.0 + (vnew - vold) / bjtVt).max(1e-12).log(),
+                              bjtVt * (vnew / bjtVt).max(1e-12).log()),
+            vnew);
+    };
+    limit(bjtVbeNew, bjtVbe);
+    limit(bjtVbcNew, bjtVbc);
+
+    bjtExpF = (bjtVbe / bjtVt).exp();
+    bjtExpR = (bjtVbc / bjtVt).exp();
+
+    for (Eigen::Index k = 0; k < nb; k++) {
+        auto& bjt = *bjts[k];
+        const double IF = bjtIs(k) * (bjtExpF(k) - 1.0);
+        const double IR = bjtIs(k) * (bjtExpR(k) - 1.0);
+        const double gF = bjtIs(k) * bjtExpF(k) / bjtVt(k);
+        const double gR = bjtIs(k) * bjtExpR(k) / bjtVt(k);
+        bjt.vbe = bjtVbe(k);
+        bjt.vbc = bjtVbc(k);
+        bjt.Ic = IF - IR * (1.0 + bjtInvBetaR(k));
+        bjt.Ib = IF * bjtInvBetaF(k) + IR * bjtInvBetaR(k);
+        bjt.gcbe = gF;
+        bjt.gcbc = -gR * (1.0 + bjtInvBetaR(k));
+        bjt.gbbe = gF * bjtInvBetaF(k);
+        bjt.gbbc = gR * bjtInvBetaR(k);
+    }
+}
+
+
+void DeviceBank::evaluateJFETs(const Eigen::VectorXd& x) {
+    const auto nj = Eigen::Index(jfets.size());
+    for (Eigen::Index k = 0; k < nj; k++) {
+        const auto& jfet = *jfets[k];
+        jfetVgs(k) = jfetPolarity(k) * (x(jfet.gate_node) - x(jfet.end_node));
+        jfetVds(k) = jfetPolarity(k) * (x(jfet.start_node) - x(jfet.end_node));
+    }
+
+    //the channel is symmetric: for vds < 0, drain and source swap roles
+    const auto reversed = jfetVds < 0;
+    const auto vgsEff = reversed.select(jfetVgs - jfetVds, jfetVgs);
+    const auto vdsEff = jfetVds.abs();
+
+    const auto overdrive = (vgsEff - jfetVto).max(0.0);
+    const auto modulation = 1.0 + jfetLambda * vdsEff;
+    const auto saturated = vdsEff >= overdrive;
+
+    jfetId = saturated.select(jfetBeta * overdrive.square() * modulation,
+                              jfetBeta * vdsEff * (2.0 * overdrive - vdsEff) * modulation);
+    jfetGm = saturated.select(2.0 * jfetBeta * overdrive * modulation,
+                              2.0 * jfetBeta * vdsEff * modulation);
+    jfetGds = saturated.select(jfetBeta * overdrive.square() * jfetLambda,
+                               2.0 * jfetBeta * (overdrive - vdsEff) * modulation
+                               + jfetBeta * vdsEff * (2.0 * overdrive - vdsEff) * jfetLambda) + 1e-12;
+
+    for (Eigen::Index k = 0; k < nj; k++) {
+        auto& jfet = *jfets[k];
+        jfet.vgs = jfetVgs(k);
+        jfet.vds = jfetVds(k);
+        if (jfetVds(k) < 0) {
+            jfet.Id = -jfetId(k);
+            jfet.gm = -jfetGm(k);
+            jfet.gds = jfetGm(k) + jfetGds(k);
+        }
+        else {
+            jfet.Id = jfetId(k);
+            jfet.gm = jfetGm(k);
+            jfet.gds = jfetGds(k);
+        }
+    }
+}
+
+
+void DeviceBank::evaluateTanhSources(const Eigen::VectorXd& x) {
+    const auto nt = Eigen::Index(tanhSources.size());
+    for (Eigen::Index k = 0; k < nt; k++) {
+        tanhVoltage(k) = x(tanhSources[k]->control_pos) - x(tanhSources[k]->control_neg);
+    }
+
+    tanhT = (tanhGm * tanhVoltage / tanhImax).tanh();
+
+    for (Eigen::Index k = 0; k < nt; k++) {
+        auto& source = *tanhSources[k];
+        source.voltage = tanhVoltage(k);
+        source.current = tanhImax(k) * tanhT(k);
+        source.conductance = tanhGm(k) * (1.0 - tanhT(k) * tanhT(k));
+    }
+}
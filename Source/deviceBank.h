@@ -0,0 +1,58 @@
+/*
+  ==============================================================================
+
+    deviceBank.h
+    Created: 19 Oct 2026 11:38:45pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+
+class Component;
+class Diode;
+class BJT;
+class JFET;
+class TanhVCCS;
+
+// Batched evaluation of the nonlinear devices at each Newton iteration.
+// The constants of the models (1/(N.Vt), Is/(N.Vt), ...) are precomputed per device in contiguous
+// arrays when the netlist is loaded. The terminal voltages of all the devices of a type are gathered,
+// the models are evaluated with Eigen array expressions (vectorised exp/tanh), and the linearizations
+// are scattered back to the devices for their stamp
+class DeviceBank {
+public:
+    void build(const std::vector<std::shared_ptr<Component>>& components);
+    void evaluate(const Eigen::VectorXd& x);
+    void resetLimiting(const Eigen::VectorXd& x);
+    void clear();
+    bool empty() const { return diodes.empty() && bjts.empty() && jfets.empty() && tanhSources.empty(); }
+
+private:
+    void evaluateDiodes(const Eigen::VectorXd& x);
+    void evaluateBJTs(const Eigen::VectorXd& x);
+    void evaluateJFETs(const Eigen::VectorXd& x);
+    void evaluateTanhSources(const Eigen::VectorXd& x);
+
+    std::vector<std::shared_ptr<Diode>> diodes;
+    std::vector<unsigned> diodeAnode, diodeCathode;
+    Eigen::ArrayXd diodeIs, diodeInvNVt, diodeIsOverNVt;
+    Eigen::ArrayXd diodeVoltage, diodeExpV;         // scratch, sized by build so that evaluate doesn't allocate
+
+    std::vector<std::shared_ptr<BJT>> bjts;
+    Eigen::ArrayXd bjtPolarity, bjtIs, bjtVt, bjtInvBetaF, bjtInvBetaR, bjtVcrit;
+    Eigen::ArrayXd bjtVbe, bjtVbc;                  // limited junction voltages of the last iteration
+    Eigen::ArrayXd bjtVbeNew, bjtVbcNew, bjtExpF, bjtExpR;
+
+    std::vector<std::shared_ptr<JFET>> jfets;
+    Eigen::ArrayXd jfetPolarity, jfetVto, jfetBeta, jfetLambda;
+    Eigen::ArrayXd jfetVgs, jfetVds, jfetId, jfetGm, jfetGds;
+
+    std::vector<std::shared_ptr<TanhVCCS>> tanhSources;
+    Eigen::ArrayXd tanhGm, tanhImax;
+    Eigen::ArrayXd tanhVoltage, tanhT;
+};
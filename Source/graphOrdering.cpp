@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    graphOrdering.cpp
+    Created: 19 Oct 2026 5:03:51pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "graphOrdering.h"
+#include <algorithm>
+#include <queue>
+
+
+// Breadth first search from start, filling levels. Returns the last vertex reached
+static unsigned breadthFirst(const std::vector<std::vector<unsigned>>& adjacency, unsigned start,
+                             std::vector<int>& levels) {
+    std::fill(levels.begin(), levels.end(), -1);
+    std::queue<unsigned> queue;
+    queue.push(start);
+    levels[start] = 0;
+    unsigned last = start;
+
+    while (!queue.empty()) {
+        last = queue.front();
+        queue.pop();
+        for (auto next : adjacency[last]) {
+            if (levels[next] < 0) {
+                levels[next] = levels[last] + 1;
+                queue.push(next);
+            }
+        }
+    }
+    return last;
+}
+
+
+std::vector<unsigned> reverseCuthillMcKee(const std::vector<std::vector<unsigned>>& adjacency) {
+    const auto size = unsigned(adjacency.size());
+    std::vector<unsigned> order;
+    std::vector<bool> visited(size, false);
+    std::vector<int> levels(size, -1);
+    order.reserve(size);
+
+    auto degree = [&](unsigned v) { return adjacency[v].size(); };
+
+    while (order.size() < size) {
+        //start each connected part from a pseudo-peripheral vertex: the lowest degree unvisited vertex,
+        //moved a few times to the farthest vertex of a breadth first search
+        unsigned start = size;
+        for (unsigned v = 0; v < size; v++) {
+            if (!visited[v] && (start == size || degree(v) < degree(start))) start = v;
+        }
+        int eccentricity = -1;
+        for (int pass = 0; pass < 4; pass++) {
+            const unsigned farthest = breadthFirst(adjacency, start, levels);
+            if (levels[farthest] <= eccentricity) break;
+            eccentricity = levels[farthest];
+            start = farthest;
+        }
+
+        //Cuthill-McKee: breadth first, neighbours taken by increasing degree
+        const size_t first = order.size();
+        order.push_back(start);
+        visited[start] = true;
+        for (size_t head = first; head < order.size(); head++) {
+            std::vector<unsigned> neighbours;
+            for (auto next : adjacency[order[head]]) {
+                if (!visited[next]) {
+                    visited[next] = true;
+                    neighbours.push_back(next);
+                }
+            }
+            std::stable_sort(neighbours.begin(), neighbours.end(),
+                [&](unsigned lhs, unsigned rhs) { return degree(lhs) < degree(rhs); });
+            order.insert(order.end(), neighbours.begin(), neighbours.end());
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+
+unsigned getBandwidth(const std::vector<std::vector<unsigned>>& pattern, const std::vector<unsigned>& order) {
+    std::vector<unsigned> position(order.size());
+    for (unsigned i = 0; i < order.size(); i++) position[order[i]] = i;
+
+    unsigned bandwidth = 0;
+    for (unsigned row = 0; row < pattern.size(); row++) {
+        for (auto col : pattern[row]) {
+            const unsigned distance = position[row] > position[col] ? position[row] - position[col] : position[col] - position[row];
+            bandwidth = std::max(bandwidth, distance);
+        }
+    }
+    return bandwidth;
+}
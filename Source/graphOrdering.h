@@ -0,0 +1,21 @@
+/*
+  ==============================================================================
+
+    graphOrdering.h
+    Created: 19 Oct 2026 5:03:51pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <vector>
+
+// Reverse Cuthill-McKee ordering of an undirected graph given by its adjacency lists.
+// Returns the vertices in their new order (order[newIndex] = oldIndex). Numbering the
+// vertices this way keeps the non-zero entries of the matrix close to the diagonal.
+std::vector<unsigned> reverseCuthillMcKee(const std::vector<std::vector<unsigned>>& adjacency);
+
+// Half bandwidth of a matrix pattern (pattern[i] lists the non-zero columns of row i),
+// once its rows and columns are permuted by order
+unsigned getBandwidth(const std::vector<std::vector<unsigned>>& pattern, const std::vector<unsigned>& order);
@@ -0,0 +1,134 @@
+/*
+  ==============================================================================
+
+    knobGrid.cpp
+    Created: 19 Oct 2026 10:12:37am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "knobGrid.h"
+#include "netlist.h"
+#include "component.h"
+#include <algorithm>
+#include <cmath>
+
+
+bool KnobGrid::build(Netlist& netlist, size_t memoryCap) {
+    clear();
+
+    if (!netlist.isInitialized || !netlist.nonlinearComponents.empty() || netlist.potentiometers.empty() || netlist.sampleRate <= 0) {
+        return false;
+    }
+
+    for (const auto& pot : netlist.potentiometers) {
+        if (std::find(axes.begin(), axes.end(), pot->knob) == axes.end()) axes.push_back(pot->knob);
+    }
+
+    //take as many points per axis as the memory cap allows
+    const auto size = netlist.A.rows() - 1;
+    const double kernelBytes = double(size) * size * sizeof(double);
+    const double maxPoints = double(memoryCap) / kernelBytes;
+    resolution = unsigned(std::floor(std::pow(maxPoints, 1.0 / axes.size()) + 1e-9));
+    resolution = std::min(resolution, maxResolution);
+    if (resolution < 2) {
+        clear();
+        return false;
+    }
+
+    size_t points = 1;
+    for (size_t a = 0; a < axes.size(); a++) points *= resolution;
+    kernels.reserve(points);
+
+    //the netlist is restamped at every grid point, then restored as it was
+    const Eigen::MatrixXd savedA = netlist.A;
+    const Eigen::VectorXd savedB = netlist.b;
+    double savedPositions[Netlist::numKnobs];
+    std::copy(netlist.knobPositions, netlist.knobPositions + Netlist::numKnobs, savedPositions);
+
+    //the grid points are spaced quadratically along each axis, since the solution moves the most
+    //when a potentiometer approaches its minimum resistance
+    Eigen::PartialPivLU<Eigen::MatrixXd> lu(size);
+    for (size_t p = 0; p < points; p++) {
+        size_t flat = p;
+        for (auto knob : axes) {
+            const double t = double(flat % resolution) / (resolution - 1);
+            netlist.knobPositions[knob] = t * t;
+            flat /= resolution;
+        }
+        netlist.A.setZero();
+        netlist.b.setZero();
+        netlist.stamp_system();
+        lu.compute(netlist.A.bottomRightCorner(size, size));
+        kernels.push_back(lu.inverse());
+    }
+
+    std::copy(savedPositions, savedPositions + Netlist::numKnobs, netlist.knobPositions);
+    for (const auto& pot : netlist.potentiometers) pot->setPosition(netlist.knobPositions[pot->knob]);
+    netlist.A = savedA;
+    netlist.b = savedB;
+
+    kernel.resize(size, size);
+    kernelSingle.resize(size, size);
+    lastPositions.assign(axes.size(), -1.0);
+    sampleRate = netlist.sampleRate;
+    return true;
+}
+
+
+void KnobGrid::clear() {
+    axes.clear();
+    kernels.clear();
+    lastPositions.clear();
+    resolution = 0;
+    sampleRate = 0;
+}
+
+
+// The companion models of the reactive components depend on the sample rate,
+// so the grid is only usable at the rate it was built for
+bool KnobGrid::isValidFor(double rate) const {
+    return !kernels.empty() && rate == sampleRate;
+}
+
+
+void KnobGrid::interpolate(const double* knobPositions) {
+    bool moved = false;
+    for (size_t a = 0; a < axes.size(); a++) {
+        moved |= knobPositions[axes[a]] != lastPositions[a];
+    }
+    if (!moved) return;
+
+    //lower corner of the grid cell and fractional position inside it, per axis
+    size_t base = 0, stride = 1;
+    double fractions[Netlist::numKnobs];
+    size_t strides[Netlist::numKnobs];
+    for (size_t a = 0; a < axes.size(); a++) {
+        lastPositions[a] = knobPositions[axes[a]];
+        const double scaled = std::sqrt(std::clamp(lastPositions[a], 0.0, 1.0)) * (resolution - 1);
+        const unsigned cell = std::min(unsigned(scaled), resolution - 2);
+        fractions[a] = scaled - cell;
+        strides[a] = stride;
+        base += cell * stride;
+        stride *= resolution;
+    }
+
+    //multilinear interpolation over the 2^d corners of the cell
+    kernel.setZero();
+    for (size_t corner = 0; corner < (size_t(1) << axes.size()); corner++) {
+        size_t flat = base;
+        double weight = 1.0;
+        for (size_t a = 0; a < axes.size(); a++) {
+            if (corner & (size_t(1) << a)) {
+                flat += strides[a];
+                weight *= fractions[a];
+            }
+            else {
+                weight *= 1.0 - fractions[a];
+            }
+        }
+        if (weight != 0.0) kernel += weight * kernels[flat];
+    }
+    if (singlePrecision) kernelSingle.noalias() = kernel.cast<float>();
+}
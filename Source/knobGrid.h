@@ -0,0 +1,37 @@
+/*
+  ==============================================================================
+
+    knobGrid.h
+    Created: 19 Oct 2026 10:12:37am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+
+class Netlist;
+
+// Solution operators A(p)^-1 of a linear netlist, tabulated on a regular grid of knob positions.
+// The grid is built off the audio thread; the audio thread then follows the knobs with
+// a multilinear interpolation and a matrix-vector product per sample, without any factorization.
+class KnobGrid {
+public:
+    bool build(Netlist& netlist, size_t memoryCap);
+    void clear();
+    bool isValidFor(double rate) const;
+    void interpolate(const double* knobPositions);
+
+    static constexpr unsigned maxResolution = 17;
+
+    std::vector<int> axes;                  // knobs driving at least one potentiometer, one grid axis each
+    unsigned resolution = 0;                // number of grid points per axis
+    std::vector<Eigen::MatrixXd> kernels;   // solution operator at each grid point
+    std::vector<double> lastPositions;      // knob positions used for the current interpolation
+    Eigen::MatrixXd kernel;                 // interpolated solution operator
+    Eigen::MatrixXf kernelSingle;           // float copy of kernel, filled when singlePrecision is set
+    bool singlePrecision = false;
+    double sampleRate = 0;
+};
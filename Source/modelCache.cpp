@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    modelCache.cpp
+    Created: 21 Oct 2026 3:26:41pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "modelCache.h"
+#include "netlist.h"
+#include <algorithm>
+#include <cstring>
+
+
+bool SharedModelCache::Key::operator==(const Key& other) const {
+    return contentHash == other.contentHash && sampleRate == other.sampleRate;
+}
+
+
+size_t SharedModelCache::KeyHash::operator()(const Key& key) const {
+    uint64_t bits;
+    std::memcpy(&bits, &key.sampleRate, sizeof(bits));
+    return size_t(key.contentHash ^ (bits + 0x9e3779b97f4a7c15 + (key.contentHash << 6) + (key.contentHash >> 2)));
+}
+
+
+SharedModelCache& SharedModelCache::getInstance() {
+    static SharedModelCache instance;
+    return instance;
+}
+
+
+std::shared_ptr<const BlockLinearModel> SharedModelCache::find(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto entry = models.find(key);
+    return entry != models.end() ? entry->second.lock() : nullptr;
+}
+
+
+std::shared_ptr<const BlockLinearModel> SharedModelCache::insert(const Key& key, std::shared_ptr<const BlockLinearModel> model) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& entry = models[key];
+    if (auto shared = entry.lock()) return shared;
+    entry = model;
+
+    //drop the models no strategy uses anymore (netlists unloaded, sample rates left)
+    for (auto it = models.begin(); it != models.end();) {
+        if (it->second.expired()) it = models.erase(it);
+        else ++it;
+    }
+    return model;
+}
+
+
+size_t SharedModelCache::getNumModels() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return models.size();
+}
+
+
+
+BlockModelBuilder::BlockModelBuilder() = default;
+BlockModelBuilder::~BlockModelBuilder() = default;
+
+
+// The model of another netlist processing the same circuit at the same sample rate, or a new one. The models of
+// circuits with potentiometers follow the knobs of their instance and aren't shared
+static std::shared_ptr<const BlockLinearModel> findOrIdentify(Netlist& netlist) {
+    if (!netlist.potentiometers.empty()) return BlockLinearModel::identify(netlist);
+
+    const SharedModelCache::Key key{ netlist.getContentHash(), netlist.sampleRate };
+    auto& cache = SharedModelCache::getInstance();
+    if (auto model = cache.find(key)) return model;
+
+    auto identified = BlockLinearModel::identify(netlist);
+    if (identified == nullptr) return nullptr;
+    return cache.insert(key, std::move(identified));
+}
+
+
+void BlockModelBuilder::prepare(Netlist& netlist) {
+    //identified with the potentiometers (or the knob grid) set as processBlock will find them
+    std::shared_ptr<const BlockLinearModel> model;
+    if (netlist.isInitialized && !netlist.voltageProbes.empty()) {
+        netlist.updatePotentiometers();
+        model = findOrIdentify(netlist);
+    }
+
+    //the copy rebuilds are identified on: the same text and solver settings, and the knob grid if the netlist follows
+    //the potentiometers with one, so that the model matches the per-sample solve it takes over from
+    createCopy = [text = netlist.sourceText, precision = netlist.activePrecision, solverOverridden = netlist.solverOverridden,
+                  solverOverride = netlist.solverOverride, solveOperatorAllowed = netlist.solveOperatorAllowed,
+                  knobGridMemoryCap = netlist.knobGrid.isValidFor(netlist.sampleRate) ? netlist.knobGridMemoryCap : 0] {
+        auto copy = std::make_unique<Netlist>();
+        copy->initFromText(text);
+        copy->setPrecision(precision);
+        copy->solverOverridden = solverOverridden;
+        copy->solverOverride = solverOverride;
+        copy->setSolveOperatorAllowed(solveOperatorAllowed);
+        copy->setKnobGridMemoryCap(knobGridMemoryCap);
+        copy->prepareChannels(1);
+        copy->setSampleRate(0);
+        return copy;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    identifiable = model != nullptr;
+    latest = current = model;
+    retired.clear();
+    requestedPositions.assign(netlist.potentiometers.size(), 0.0);
+    rebuildRequested = false;
+    copy = nullptr;
+}
+
+
+const BlockLinearModel* BlockModelBuilder::acquire(const Netlist& netlist) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+
+    //the model it replaces stays in retired, so that it isn't freed here
+    if (lock.owns_lock() && current != latest) current = latest;
+    if (current != nullptr && current->isValidFor(netlist)) return current.get();
+
+    //requested once the knobs are where they were at the previous block, so that the rebuild doesn't chase them
+    if (lock.owns_lock() && identifiable) {
+        bool settled = requestedRate == netlist.sampleRate;
+        requestedRate = netlist.sampleRate;
+        for (size_t j = 0; j < requestedPositions.size(); j++) {
+            const double position = netlist.knobPositions[netlist.potentiometers[j]->knob];
+            settled &= requestedPositions[j] == position;
+            requestedPositions[j] = position;
+        }
+        if (settled) rebuildRequested = true;
+    }
+    return nullptr;
+}
+
+
+void BlockModelBuilder::rebuild() {
+    double rate;
+    std::vector<double> positions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!rebuildRequested || createCopy == nullptr) return;
+        rebuildRequested = false;
+        rate = requestedRate;
+        positions = requestedPositions;
+    }
+
+    if (copy == nullptr) copy = createCopy();
+    if (!copy->isInitialized) return;
+    for (size_t j = 0; j < positions.size(); j++) copy->setKnobPosition(copy->potentiometers[j]->knob, positions[j]);
+    if (copy->sampleRate != rate) {
+        copy->change_sample_rate(rate);
+        copy->precompute_knob_grid();
+    }
+    copy->updatePotentiometers();
+    auto model = findOrIdentify(*copy);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    retired.push_back(std::move(latest));
+    latest = std::move(model);
+    releaseUnused();
+}
+
+
+// Free the replaced models the audio thread doesn't hold anymore. Called with the mutex held
+void BlockModelBuilder::releaseUnused() {
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+        [](const std::shared_ptr<const BlockLinearModel>& model) { return model == nullptr || model.use_count() == 1; }), retired.end());
+}
@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    modelCache.h
+    Created: 21 Oct 2026 3:26:41pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "processStartegy.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide registry of the BlockLinearModel of the circuits being processed. Plugin instances running the
+// same netlist at the same sample rate (a mixing template with the circuit on every track) identify the map once
+// and share its matrices: one copy in memory, which stays in cache while the host processes the instances one
+// after the other. Only the state of each channel is kept per instance.
+// Only circuits without potentiometers are registered, their model depending on nothing else, and the cache is
+// only used by the threads loading netlists and rebuilding models, never by the audio thread.
+// Entries are held weakly and go away with the last strategy using them
+class SharedModelCache {
+public:
+    struct Key {
+        uint64_t contentHash;               // Netlist::getContentHash
+        double sampleRate;
+
+        bool operator==(const Key& other) const;
+    };
+
+    static SharedModelCache& getInstance();
+
+    std::shared_ptr<const BlockLinearModel> find(const Key& key);
+    // Returns the model shared under the key, which is the given one unless another thread inserted one first
+    std::shared_ptr<const BlockLinearModel> insert(const Key& key, std::shared_ptr<const BlockLinearModel> model);
+    size_t getNumModels();
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    // Only held for the lookups; the models are identified outside of it
+    std::mutex mutex;
+    std::unordered_map<Key, std::weak_ptr<const BlockLinearModel>, KeyHash> models;
+};
+
+
+// Identifies the BlockLinearModel of a netlist away from the audio thread. prepare identifies the model for the
+// conditions the netlist is loaded in, on the thread loading it. When the audio thread finds that the sample rate
+// or a potentiometer changed, it solves per sample, and requests another model once the knobs have stopped moving:
+// rebuild identifies it on a background thread, on a copy of the netlist solved the same way (with the knob grid
+// or the low-rank updates), and the audio thread switches to it at the start of a block.
+// The audio thread never waits for the mutex, and never allocates or frees a model
+class BlockModelBuilder {
+public:
+    BlockModelBuilder();
+    ~BlockModelBuilder();
+
+    // On the loading thread, while the netlist isn't processed
+    void prepare(Netlist& netlist);
+    // On the audio thread: the model for the current sample rate and potentiometer positions, nullptr while it isn't ready
+    const BlockLinearModel* acquire(const Netlist& netlist);
+
+    bool isRebuildRequested() const { return rebuildRequested; }
+    // On a background thread, as soon as isRebuildRequested: identify the model last requested by acquire
+    void rebuild();
+
+private:
+    void releaseUnused();
+
+    std::mutex mutex;                                               // only tried by the audio thread
+    std::shared_ptr<const BlockLinearModel> latest;                 // guarded by mutex
+    std::vector<std::shared_ptr<const BlockLinearModel>> retired;   // replaced models, until the audio thread drops them
+    double requestedRate = 0;                                       // at the last acquire without a model, guarded by mutex
+    std::vector<double> requestedPositions;                         // of the potentiometers, likewise
+    std::atomic<bool> rebuildRequested{ false };
+
+    std::shared_ptr<const BlockLinearModel> current;                // audio thread
+    bool identifiable = false;                                      // the state is small enough
+
+    std::function<std::unique_ptr<Netlist>()> createCopy;          // loads the netlist with the settings it was prepared with
+    std::unique_ptr<Netlist> copy;                                  // background thread
+};
@@ -1,15 +1,40 @@
 //netlist.cpp
 #include "Netlist.h"
 #include "component.h"
+#include "graphOrdering.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <typeinfo>
 
 
-Netlist::Netlist(const std::string& filename) {
+Netlist::Netlist() {
+    setIntegrationMethod(IntegrationMethod::Trapezoidal);
+}
+
+Netlist::Netlist(const std::string& filename) : Netlist() {
     init(filename);
 }
 
 void Netlist::init(const std::string& filename) {
+    std::ifstream netlistTxt(filename, std::ios::binary);
+    if (!netlistTxt.is_open()) {
+        std::cout << "Unable to open the netlist file" << std::endl;
+    }
+    const std::string text((std::istreambuf_iterator<char>(netlistTxt)), std::istreambuf_iterator<char>());
+    initFromText(text);
+}
+
+// Load a netlist from its text, as read from a netlist file
+void Netlist::initFromText(const std::string& text) {
+    //the components of a previous load live in its arena, released with them, and its directives don't carry over
+    reset();
+    sourceText = text;
 
-    components = createComponentListFromTxt(filename);
+    components = createComponentList(text);
     voltageProbes = getComponents<VoltageProbe>();
     //if there is no component in the netlist or not any voltageProbes
     //the system is not initialized and we not define the A matrix, the vector x and b, and so on
@@ -22,42 +47,98 @@ void Netlist::init(const std::string& filename) {
         
     }
 
-    resistances         = getComponents<Resistance>();
-    reactiveComponents  = getComponents<ReactiveComponent>();
-    idealOPAs           = getComponents<IdealOPA>();
-    voltageSources      = getComponents<VoltageSource>();
-    currentSources      = getComponents<CurrentSource>();
-    diodes 			    = getComponents<Diode>();
+    renumberNodes();
+
+    collectComponentLists();
+    deviceBank.build(components);
 
     m = std::size(voltageSources) + std::size(reactiveComponents) + std::size(idealOPAs);
     n = getNodeNbr();       // Total number of unique nodes
 
     A.resize(n + m, n + m);
     x.resize(n + m);
+    xPrev.resize(n + m);
     b.resize(n + m);
 
     A.setZero();
     x.setZero();
+    xPrev.setZero();
     b.setZero();
 
+    //the operating point is solved by the loader once the sample rate is set (see solve_operating_point)
     initializeProcessStrategy();
 }
 
 
+// Per-type lists of the components, in a single pass over them. A component may be in several lists
+// (a potentiometer is a resistance, the capacitors and inductances are reactive components)
+void Netlist::collectComponentLists() {
+    resistances.clear();
+    potentiometers.clear();
+    reactiveComponents.clear();
+    idealOPAs.clear();
+    voltageSources.clear();
+    currentSources.clear();
+    diodes.clear();
+    nonlinearComponents.clear();
+
+    for (const auto& comp : components) {
+        if (auto resistance = std::dynamic_pointer_cast<Resistance>(comp)) {
+            if (auto pot = std::dynamic_pointer_cast<Potentiometer>(resistance)) potentiometers.push_back(std::move(pot));
+            resistances.push_back(std::move(resistance));
+        }
+        else if (auto reactive = std::dynamic_pointer_cast<ReactiveComponent>(comp))   reactiveComponents.push_back(std::move(reactive));
+        else if (auto source = std::dynamic_pointer_cast<VoltageSource>(comp))         voltageSources.push_back(std::move(source));
+        else if (auto current = std::dynamic_pointer_cast<CurrentSource>(comp))        currentSources.push_back(std::move(current));
+        else if (auto opa = std::dynamic_pointer_cast<IdealOPA>(comp))                 idealOPAs.push_back(std::move(opa));
+        else if (auto diode = std::dynamic_pointer_cast<Diode>(comp))                  diodes.push_back(std::move(diode));
+
+        if (comp->isNonlinear()) nonlinearComponents.push_back(comp);
+    }
+}
+
+
+// Back to the state of a netlist that hasn't been loaded: no components, and the defaults of everything
+// the text sets (directives, models, subcircuits). The knob positions and the settings of the plugin are kept
 void Netlist::reset() {
 
     components.clear();
     resistances.clear();
+    potentiometers.clear();
     reactiveComponents.clear();
     idealOPAs.clear();
     voltageSources.clear();
     currentSources.clear();
     voltageProbes.clear();
     diodes.clear();
+    nonlinearComponents.clear();
+    deviceBank.clear();
+    componentArena.reset();
+    models.clear();
+    subcircuits.clear();
+    subcircuitNodeKeys.clear();
+    nextInternalNode = 0;
+
+    setIntegrationMethod(IntegrationMethod::Trapezoidal);
+    setPrecision(Precision::Double);
+    activePrecision = Precision::Double;
+    setSolveOperatorAllowed(true);
+    solveOperatorActive = false;
+    linearStrategy = LinearStrategy::Block;
+    convolutionRequested = false;
+    convolutionTolerance = 1e-4;
+    impulseResponse.clear();
+    impulseResponseRate = 0;
+    impulsePartitionSize = 0;
 
     A.setZero();
     x.setZero();
+    xPrev.setZero();
     b.setZero();
+    blockSolver.clear();
+    bandedSolver.clear();
+    solverMode = SolverMode::DenseLU;
+    knobGrid.clear();
      
     m = 0;
     n = 0;
@@ -69,14 +150,557 @@ void Netlist::reset() {
 void Netlist::clear_system() {
     A.setZero();
     x.setZero();
+    xPrev.setZero();
     b.setZero();
 }
 
 
-void Netlist::solve_system() {
-    for (const auto& comp : reactiveComponents) comp->setResistance(1 / sampleRate);
+// Stamp every component in A and b, for the current sample rate and knob positions
+void Netlist::stamp_system() {
+    for (const auto& comp : reactiveComponents) comp->setResistance(1 / sampleRate, integrationStages[0]);
+    for (const auto& pot : potentiometers) pot->setPosition(knobPositions[pot->knob]);
     for (const auto& comp : components) comp->stamp(*this);
+}
+
+
+void Netlist::solve_system() {
+    stamp_system();
     luDecomp.compute(A.bottomRightCorner(A.rows() - 1, A.cols() - 1));
+
+    choose_solver();
+    choose_precision();
+    //the dense factors are computed above and the banded ones by choose_solver
+    if (solverMode == SolverMode::Blocks) factorize();
+
+    //precompute the low-rank terms used to follow the potentiometers without refactorizing A
+    const auto size = A.rows() - 1;
+    const auto k = potentiometers.size();
+
+    Eigen::MatrixXd U = Eigen::MatrixXd::Zero(size, k);
+    potReference.resize(k);
+    for (unsigned j = 0; j < k; j++) {
+        const auto& pot = potentiometers[j];
+        if (pot->start_node != 0) U(pot->start_node - 1, j) = 1;
+        if (pot->end_node != 0)   U(pot->end_node - 1, j) = -1;
+        potReference(j) = pot->admittance;
+    }
+    potW = luDecomp.solve(U);
+    potC = U.transpose() * potW;
+    potCorrection = Eigen::MatrixXd::Zero(k, k);
+    potDelta = Eigen::VectorXd::Zero(k);
+    potProjection = Eigen::VectorXd::Zero(k);
+    potLU = Eigen::PartialPivLU<Eigen::MatrixXd>(k);
+    potCorrectionActive = false;
+
+    choose_solve_operator();
+}
+
+
+// DC operating point, for the current knob positions and a silent input: capacitors open,
+// inductors shorted. Newton's method is tried from x = 0, then with gmin stepping, then with
+// source stepping. The solution seeds x, xPrev and the channel states, so that playback starts
+// from the settled circuit instead of going through the power-up transient. A and b are left as
+// they were. Called by the loaders after initFromText and setSampleRate, not on the audio thread
+bool Netlist::solve_operating_point() {
+    const Eigen::MatrixXd savedA = A;
+    const Eigen::VectorXd savedB = b;
+
+    for (const auto& pot : potentiometers) pot->setPosition(knobPositions[pot->knob]);
+    for (auto& source : voltageSources) {
+        if (auto* externalSource = dynamic_cast<ExternalVoltageSource*>(source.get())) externalSource->update(0.0);
+    }
+
+    x.setZero();
+    bool converged = solve_dc(1e-12, 1.0);
+
+    //gmin stepping: every node starts strongly tied to ground, and is released step by step
+    if (!converged) {
+        x.setZero();
+        converged = true;
+        for (double gmin = 1e-2; converged && gmin > 1e-13; gmin *= 0.1) converged = solve_dc(gmin, 1.0);
+    }
+    //source stepping: the supplies are ramped up from 0
+    if (!converged) {
+        x.setZero();
+        converged = true;
+        for (unsigned step = 1; converged && step <= 20; step++) converged = solve_dc(1e-12, step / 20.0);
+    }
+    if (!converged) x.setZero();
+
+    xPrev = x;
+    A = savedA;
+    b = savedB;
+    for (auto& state : channelXStates) state = x;
+    for (auto& state : channelXPrevStates) state = x;
+    return converged;
+}
+
+
+// Newton's method on the DC system, from the current x. gmin is added from every node to the ground,
+// and the independent sources are scaled by sourceScale. The junction limiting starts over from x,
+// so that a failed attempt doesn't hold back the next one
+bool Netlist::solve_dc(double gmin, double sourceScale) {
+    Eigen::PartialPivLU<Eigen::MatrixXd> dcDecomp;
+    deviceBank.resetLimiting(x);
+
+    for (unsigned k = 0; k < 100; k++) {
+        A.setZero();
+        b.setZero();
+
+        for (const auto& comp : components) {
+            if (!comp->isNonlinear()) comp->stamp(*this);
+        }
+        b *= sourceScale;
+
+        for (const auto& comp : reactiveComponents) {
+            const unsigned row = n + comp->index;
+            if (dynamic_cast<Capacitor*>(comp.get()) != nullptr) {
+                A.row(row).setZero();
+                A(row, row) = 1;
+            }
+            else {
+                A(row, row) = 0;
+            }
+            b(row) = 0;
+        }
+        for (unsigned node = 1; node < n; node++) A(node, node) += gmin;
+
+        update_nonlinear();
+        for (const auto& comp : nonlinearComponents) comp->stamp(*this);
+
+        const Eigen::VectorXd x_old = x;
+        dcDecomp.compute(A.bottomRightCorner(A.rows() - 1, A.cols() - 1));
+        x.tail(x.size() - 1) = dcDecomp.solve(b.tail(b.size() - 1));
+
+        if (!x.allFinite()) return false;
+        if ((x_old - x).norm() < 1e-9) return true;
+    }
+    return false;
+}
+
+
+// Tabulate the solution operator over the knob positions (see KnobGrid).
+// This factorizes one matrix per grid point, so it must not be called from the audio thread
+bool Netlist::precompute_knob_grid() {
+    if (knobGridMemoryCap == 0) {
+        knobGrid.clear();
+        return false;
+    }
+    return knobGrid.build(*this, knobGridMemoryCap);
+}
+
+
+// Impulse response of a linear circuit (see impulseResponse), computed with the regular solve from the current
+// state: a run with a unit impulse at the input and a run with a silent input are stepped side by side, and
+// their difference is kept until it has stayed below the tolerance for 50 ms. Circuits that don't decay
+// within maxImpulseSeconds (integrators, oscillators) have no usable response. Not for the audio thread
+bool Netlist::precompute_impulse_response() {
+    impulseResponse.clear();
+    if (!convolutionRequested || !isInitialized || !nonlinearComponents.empty() || voltageProbes.empty() || sampleRate <= 0) {
+        return false;
+    }
+
+    //recorded even if the circuit has no usable response, so that it isn't computed again at the same positions
+    updatePotentiometers();
+    impulseResponseKnobs.clear();
+    for (const auto& pot : potentiometers) impulseResponseKnobs.push_back(knobPositions[pot->knob]);
+    const Eigen::VectorXd savedX = x, savedXPrev = xPrev, savedB = b;
+    Eigen::VectorXd silentX = x, silentXPrev = xPrev, silentB = b;
+    const auto& probe = voltageProbes[0];
+
+    auto step = [this, &probe](Eigen::VectorXd& stateX, Eigen::VectorXd& stateXPrev, Eigen::VectorXd& stateB, double input) {
+        x.swap(stateX);
+        xPrev.swap(stateXPrev);
+        b.swap(stateB);
+        for (unsigned stage = 0; stage < numIntegrationStages; stage++) {
+            begin_stage(stage, input);
+            solve_step();
+        }
+        const double output = x(probe->start_node) - x(probe->end_node);
+        x.swap(stateX);
+        xPrev.swap(stateXPrev);
+        b.swap(stateB);
+        return output;
+    };
+
+    Eigen::VectorXd impulseX = x, impulseXPrev = xPrev, impulseB = b;
+    const size_t maxLength = size_t(maxImpulseSeconds * sampleRate);
+    const size_t quietLength = std::max(size_t(1024), size_t(0.05 * sampleRate));
+    double peak = 0, silentOutput = 0;
+    size_t quiet = 0;
+    for (size_t k = 0; k < maxLength && quiet < quietLength; k++) {
+        silentOutput = step(silentX, silentXPrev, silentB, 0.0);
+        const double response = step(impulseX, impulseXPrev, impulseB, k == 0 ? 1.0 : 0.0) - silentOutput;
+        impulseResponse.push_back(float(response));
+
+        peak = std::max(peak, std::abs(response));
+        quiet = std::abs(response) < convolutionTolerance * peak ? quiet + 1 : 0;
+    }
+
+    x = savedX;
+    xPrev = savedXPrev;
+    b = savedB;
+
+    if (quiet < quietLength || peak == 0) {
+        impulseResponse.clear();
+        return false;
+    }
+    impulseResponse.resize(impulseResponse.size() - quiet);
+    impulseOffset = silentOutput;
+    impulseResponseRate = sampleRate;
+    impulseResponseVersion++;
+    return true;
+}
+
+
+// Solve the current linear system with the factorization computed in solve_system,
+// corrected for any potentiometer move since then
+void Netlist::solve_step() {
+    auto xs = x.tail(x.size() - 1);
+
+    if (knobGrid.isValidFor(sampleRate)) {
+        if (activePrecision != Precision::Double && knobGrid.kernelSingle.rows() == knobGrid.kernel.rows()) {
+            bSingle = b.tail(b.size() - 1).cast<float>();
+            xSingle.noalias() = knobGrid.kernelSingle * bSingle;
+            xs = xSingle.cast<double>();
+        }
+        else {
+            xs.noalias() = knobGrid.kernel * b.tail(b.size() - 1);
+        }
+        return;
+    }
+
+    //with the solution operator, only the rows of x read later on are updated
+    if (solveOperatorActive) {
+        for (size_t j = 0; j < operatorColumns.size(); j++) operatorInput(j) = b(operatorColumns[j]);
+        operatorOutput.noalias() = solveOperator * operatorInput;
+        for (size_t i = 0; i < operatorRows.size(); i++) x(operatorRows[i]) = operatorOutput(i);
+    }
+    else {
+        solve_factorized();
+    }
+
+    if (potCorrectionActive) {
+        for (unsigned j = 0; j < potentiometers.size(); j++) {
+            const auto& pot = potentiometers[j];
+            potProjection(j) = x(pot->start_node) - x(pot->end_node);
+        }
+        if (solveOperatorActive) {
+            operatorOutput.noalias() = solveOperatorPotW * (potCorrection * potProjection);
+            for (size_t i = 0; i < operatorRows.size(); i++) x(operatorRows[i]) -= operatorOutput(i);
+        }
+        else {
+            xs.noalias() -= potW * (potCorrection * potProjection);
+        }
+    }
+}
+
+
+// Compare the cost of one solve with the dense LU, with the system split in its strongly
+// connected blocks and with the banded LU, and keep the cheapest
+void Netlist::choose_solver() {
+    const auto pattern = getSparsityPattern();
+    const double size = double(pattern.size());
+
+    solverMode = SolverMode::DenseLU;
+    double cost = size * size;
+
+    if (blockSolver.analyse(pattern, getInstanceKeys()) && blockSolver.isActive() && blockSolver.getSolveCost() < cost) {
+        solverMode = SolverMode::Blocks;
+        cost = blockSolver.getSolveCost();
+    }
+
+    bandedSolver.analyse(pattern);
+    if (bandedSolver.getSolveCost() < cost) {
+        solverMode = SolverMode::Banded;
+        cost = bandedSolver.getSolveCost();
+    }
+
+    if (solverOverridden) {
+        solverMode = solverOverride == SolverMode::Blocks && !blockSolver.isActive() ? SolverMode::DenseLU : solverOverride;
+        cost = solverMode == SolverMode::Blocks ? blockSolver.getSolveCost()
+             : solverMode == SolverMode::Banded ? bandedSolver.getSolveCost() : size * size;
+    }
+
+    //the banded LU stops at a zero pivot instead of letting inf/NaN reach x; the dense LU is kept then
+    if (solverMode == SolverMode::Banded && !bandedSolver.factorize(A.bottomRightCorner(A.rows() - 1, A.cols() - 1))) {
+        solverMode = SolverMode::DenseLU;
+        cost = size * size;
+    }
+    solveCost = cost;
+}
+
+
+// Pick the precision of the per-sample solve. Nonlinear circuits are refactorized at each
+// Newton iteration and stay in double. In Auto, float is only used when the dense float solve
+// (counted as half the cost of a double one) beats the chosen solver, when the condition
+// estimate of A leaves a float solve at least one correct digit, and when a simulated run in
+// float stays within -100 dB of the double one. The estimate is pessimistic for MNA matrices,
+// whose rows mix conductances and unit entries, so the run decides; it also shows the rounding
+// errors building up through the state of the capacitors and inductors
+void Netlist::choose_precision() {
+    activePrecision = Precision::Double;
+    knobGrid.singlePrecision = false;
+    luFactorsSingle.resize(0, 0);
+    if (!nonlinearComponents.empty() || precision == Precision::Double) return;
+
+    const auto size = A.rows() - 1;
+    activePrecision = precision == Precision::Auto ? Precision::Mixed : precision;
+    prepare_single();
+
+    if (precision == Precision::Auto) {
+        //the conversions of b and x to and from float are counted too
+        const double denseSingleCost = 0.5 * double(size) * double(size) + 2.0 * double(size);
+        const double maxError = 1e-5;
+        const bool accurate = denseSingleCost < solveCost
+            && luDecomp.rcond() > 10 * std::numeric_limits<float>::epsilon()
+            && simulate_single_error(4096) < maxError;
+
+        if (!accurate) {
+            activePrecision = Precision::Double;
+            luFactorsSingle.resize(0, 0);
+            return;
+        }
+    }
+
+    solverMode = SolverMode::DenseLU;
+    solveCost = 0.5 * double(size) * double(size);
+    knobGrid.singlePrecision = true;
+    //the grid may already have been interpolated in double only
+    if (knobGrid.kernelSingle.rows() == knobGrid.kernel.rows()) knobGrid.kernelSingle.noalias() = knobGrid.kernel.cast<float>();
+}
+
+
+void Netlist::setPrecision(Precision newPrecision) {
+    precision = newPrecision;
+}
+
+
+// Precompute the solution operator of a linear circuit (see solveOperator), and use it when its
+// product costs less than a solve with the chosen solver. Its rows are the nodes of the probes,
+// reactive components and potentiometers and the current rows of the reactive components; its
+// columns are the rows of b written by the voltage, current and reactive sources.
+// Must be called after the potentiometer terms of solve_system, since it keeps rows of potW too
+void Netlist::choose_solve_operator() {
+    solveOperatorActive = false;
+    solveOperator.resize(0, 0);
+    solveOperatorPotW.resize(0, 0);
+    operatorRows.clear();
+    operatorColumns.clear();
+
+    const bool forcedSingle = precision == Precision::Single || precision == Precision::Mixed;
+    if (!solveOperatorAllowed || forcedSingle || !nonlinearComponents.empty()) return;
+
+    std::vector<bool> isRow(n + m, false), isColumn(n + m, false);
+    for (const auto& probe : voltageProbes) {
+        isRow[probe->start_node] = isRow[probe->end_node] = true;
+    }
+    for (const auto& comp : reactiveComponents) {
+        isRow[comp->start_node] = isRow[comp->end_node] = isRow[n + comp->index] = true;
+        isColumn[n + comp->index] = true;
+    }
+    for (const auto& pot : potentiometers) {
+        isRow[pot->start_node] = isRow[pot->end_node] = true;
+    }
+    for (const auto& source : voltageSources) {
+        isColumn[n + source->index] = true;
+    }
+    for (const auto& source : currentSources) {
+        isColumn[source->start_node] = isColumn[source->end_node] = true;
+    }
+    //x(0) and b(0) belong to the ground, which is out of the system
+    for (unsigned k = 1; k < n + m; k++) {
+        if (isRow[k]) operatorRows.push_back(k);
+        if (isColumn[k]) operatorColumns.push_back(k);
+    }
+
+    const double rows = double(operatorRows.size()), columns = double(operatorColumns.size());
+    if (rows * columns + rows + columns >= solveCost) {
+        operatorRows.clear();
+        operatorColumns.clear();
+        return;
+    }
+
+    //columns of A^-1 for the source rows, then the rows that are read
+    const auto size = A.rows() - 1;
+    Eigen::MatrixXd unitColumns = Eigen::MatrixXd::Zero(size, operatorColumns.size());
+    for (size_t j = 0; j < operatorColumns.size(); j++) unitColumns(operatorColumns[j] - 1, j) = 1;
+    const Eigen::MatrixXd inverseColumns = luDecomp.solve(unitColumns);
+
+    solveOperator.resize(operatorRows.size(), operatorColumns.size());
+    solveOperatorPotW.resize(operatorRows.size(), potW.cols());
+    for (size_t i = 0; i < operatorRows.size(); i++) {
+        solveOperator.row(i) = inverseColumns.row(operatorRows[i] - 1);
+        solveOperatorPotW.row(i) = potW.row(operatorRows[i] - 1);
+    }
+    operatorInput.resize(operatorColumns.size());
+    operatorOutput.resize(operatorRows.size());
+    solveCost = rows * columns;
+    solveOperatorActive = true;
+}
+
+
+void Netlist::setSolveOperatorAllowed(bool allowed) {
+    solveOperatorAllowed = allowed;
+}
+
+
+// Float copy of the dense LU factors, computed in float (Single) or rounded from luDecomp (Mixed)
+void Netlist::prepare_single() {
+    const auto size = A.rows() - 1;
+    if (activePrecision == Precision::Single) {
+        const Eigen::PartialPivLU<Eigen::MatrixXf> singleDecomp(A.bottomRightCorner(size, size).cast<float>());
+        luFactorsSingle = singleDecomp.matrixLU();
+        luRowOrder = singleDecomp.permutationP().indices();
+    }
+    else {
+        luFactorsSingle = luDecomp.matrixLU().cast<float>();
+        luRowOrder = luDecomp.permutationP().indices();
+    }
+    bSingle.resize(size);
+    xSingle.resize(size);
+}
+
+
+// Solve A.x = b in float with the factors of prepare_single
+void Netlist::solve_single() {
+    const auto size = A.rows() - 1;
+    for (Eigen::Index i = 0; i < size; i++) bSingle(luRowOrder(i)) = float(b(i + 1));
+    luFactorsSingle.triangularView<Eigen::UnitLower>().solveInPlace(bSingle);
+    luFactorsSingle.triangularView<Eigen::Upper>().solveInPlace(bSingle);
+    x.tail(size) = bSingle.cast<double>();
+}
+
+
+// Run numSamples of a noise input through the circuit with the double solve, then with the float
+// one, from the current state, and return the largest difference of the outputs relative to the
+// peak of the double one. The state of the circuit is restored afterwards
+double Netlist::simulate_single_error(unsigned numSamples) {
+    const auto size = A.rows() - 1;
+    const Eigen::VectorXd savedX = x, savedXPrev = xPrev, savedB = b;
+    std::vector<double> savedVoltages;
+    for (const auto& comp : reactiveComponents) savedVoltages.push_back(comp->voltage);
+
+    const Eigen::VectorXd input = Eigen::VectorXd::Random(numSamples);
+    const auto& probe = voltageProbes[0];
+    std::vector<double> reference(numSamples);
+    double peak = 0, error = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        x = savedX;
+        xPrev = savedXPrev;
+        b = savedB;
+        for (size_t k = 0; k < reactiveComponents.size(); k++) reactiveComponents[k]->voltage = savedVoltages[k];
+
+        for (unsigned i = 0; i < numSamples; i++) {
+            for (unsigned stage = 0; stage < numIntegrationStages; stage++) {
+                begin_stage(stage, input(i));
+                if (pass == 0) x.tail(size) = luDecomp.solve(b.tail(size));
+                else solve_single();
+            }
+            const double output = x(probe->start_node) - x(probe->end_node);
+            if (pass == 0) {
+                reference[i] = output;
+                peak = std::max(peak, std::abs(output));
+            }
+            else {
+                error = std::max(error, std::abs(output - reference[i]));
+            }
+        }
+    }
+
+    x = savedX;
+    xPrev = savedXPrev;
+    b = savedB;
+    for (size_t k = 0; k < reactiveComponents.size(); k++) reactiveComponents[k]->voltage = savedVoltages[k];
+    return peak > 0 ? error / peak : 0.0;
+}
+
+
+// Factorize the current (reduced) A matrix with the solver chosen for this circuit
+void Netlist::factorize() {
+    const auto reducedA = A.bottomRightCorner(A.rows() - 1, A.cols() - 1);
+
+    switch (solverMode) {
+    case SolverMode::Blocks:
+        blockSolver.factorize(reducedA);
+        break;
+    case SolverMode::Banded:
+        if (bandedSolver.factorize(reducedA)) break;
+        //a zero pivot at a Newton iteration: the dense LU takes over from there on
+        solverMode = SolverMode::DenseLU;
+        [[fallthrough]];
+    default:
+        luDecomp.compute(reducedA);
+        if (activePrecision != Precision::Double) prepare_single();
+    }
+}
+
+
+// Solve A.x = b with the last factorization (the ground row and column being removed)
+void Netlist::solve_factorized() {
+    switch (solverMode) {
+    case SolverMode::Blocks:
+        blockSolver.solve(b.tail(b.size() - 1), x.tail(x.size() - 1));
+        break;
+    case SolverMode::Banded:
+        bandedSolver.solve(b.tail(b.size() - 1), x.tail(x.size() - 1));
+        break;
+    default:
+        if (activePrecision != Precision::Double) solve_single();
+        else x.tail(x.size() - 1) = luDecomp.solve(b.tail(b.size() - 1));
+    }
+}
+
+
+// Linearize the nonlinear components around the current solution, before the Newton iteration restamps A and b
+void Netlist::update_nonlinear() {
+    deviceBank.evaluate(x);
+}
+
+
+void Netlist::setKnobPosition(unsigned knob, double position) {
+    if (knob < unsigned(numKnobs)) knobPositions[knob] = position;
+}
+
+
+void Netlist::setKnobGridMemoryCap(size_t bytes) {
+    knobGridMemoryCap = bytes;
+}
+
+
+// Apply the knob positions to the potentiometers. Only a k x k system is refactorized
+// (k being the number of potentiometers), so this is cheap enough to run once per block
+void Netlist::updatePotentiometers() {
+    if (knobGrid.isValidFor(sampleRate)) {
+        knobGrid.interpolate(knobPositions);
+        return;
+    }
+
+    bool moved = false;
+    for (unsigned j = 0; j < potentiometers.size(); j++) {
+        const auto& pot = potentiometers[j];
+        if (pot->position != knobPositions[pot->knob]) {
+            pot->setPosition(knobPositions[pot->knob]);
+            potDelta(j) = pot->admittance - potReference(j);
+            moved = true;
+        }
+    }
+    if (!moved) return;
+
+    potCorrectionActive = !potDelta.isZero(0.0);
+    if (!potCorrectionActive) return;
+
+    potCorrection.noalias() = potDelta.asDiagonal() * potC;
+    potCorrection.diagonal().array() += 1.0;
+    potLU.compute(potCorrection);
+
+    //(I + D*C)^-1 * D, solved in place: the right-hand side is D with the rows permuted as in potLU
+    potCorrection.setZero();
+    const auto& rowOrder = potLU.permutationP().indices();
+    for (Eigen::Index j = 0; j < potDelta.size(); j++) potCorrection(rowOrder(j), j) = potDelta(j);
+    potLU.matrixLU().triangularView<Eigen::UnitLower>().solveInPlace(potCorrection);
+    potLU.matrixLU().triangularView<Eigen::Upper>().solveInPlace(potCorrection);
 }
 
 
@@ -93,11 +717,62 @@ void Netlist::processBlock(juce::dsp::AudioBlock<float>& audioBlock) {
 }
 
 void Netlist::initializeProcessStrategy() {
-    if (diodes.empty()) {
-        setStrategy(std::make_unique<LinearProcessStrategy>());
+    standbyStrategy = nullptr;
+    setStrategy(createProcessStrategy(offlineRendering));
+}
+
+std::unique_ptr<ProcessStrategy> Netlist::createProcessStrategy(bool offline) const {
+    if (offline) {
+        return std::make_unique<VariableStepProcessStrategy>();
     }
-    else {
-        setStrategy(std::make_unique<NonLinearProcessStrategy>());
+    else if (nonlinearComponents.empty() && linearStrategy == LinearStrategy::Convolution && convolutionRequested) {
+        return std::make_unique<ConvolutionProcessStrategy>();
+    }
+    else if (nonlinearComponents.empty() && linearStrategy == LinearStrategy::PerSample) {
+        return std::make_unique<LinearProcessStrategy>();
+    }
+    else if (nonlinearComponents.empty()) {
+        return std::make_unique<BlockLinearProcessStrategy>();
+    }
+    return std::make_unique<NonLinearProcessStrategy>();
+}
+
+// Precompute what the strategies need before processing, once the system is solved for the rate it will run at:
+// the model of the sub-block strategy and the buffers of the strategy. previous is the netlist this one is an
+// edit of, whose state it will take over (see copyStateFrom). The strategy of the other mode (realtime or offline)
+// is created and prepared as well, for setOfflineRendering. Called by the loaders, not on the audio thread
+void Netlist::prepareProcessStrategy(const Netlist* previous) {
+    if (!isInitialized) return;
+    if (nonlinearComponents.empty()) blockModelBuilder.prepare(*this);
+    impulsePartitionSize = previous != nullptr ? previous->impulsePartitionSize : 0;
+    processStrategy->prepare(*this);
+
+    if (standbyStrategy == nullptr) standbyStrategy = createProcessStrategy(!offlineRendering);
+    standbyStrategy->prepare(*this);
+}
+
+// Switch between the fixed step strategies and the variable step one, used for offline rendering. Both are
+// prepared by prepareProcessStrategy, and the variable step one factorizes its steps with its own copy of the
+// solver, so that on the audio thread this only swaps them and resets the companion resistances
+void Netlist::setOfflineRendering(bool shouldRenderOffline) {
+    if (shouldRenderOffline == offlineRendering) return;
+
+    offlineRendering = shouldRenderOffline;
+
+    //the strategy left is kept, so that switching back finds it prepared, and the one taking over
+    //continues from the state it leaves
+    processStrategy->flushState(*this);
+    std::swap(processStrategy, standbyStrategy);
+    if (processStrategy == nullptr) {
+        auto standby = std::move(standbyStrategy);
+        initializeProcessStrategy();
+        standbyStrategy = std::move(standby);
+    }
+    if (standbyStrategy != nullptr) processStrategy->copyStateFrom(*standbyStrategy);
+
+    //the variable step strategy sets the companion resistances for the length of its steps
+    if (!offlineRendering) {
+        for (const auto& comp : reactiveComponents) comp->setResistance(1 / sampleRate, integrationStages[0]);
     }
 }
 
@@ -122,100 +797,675 @@ void Netlist::setSampleRate(double sampleRate) {
     this->sampleRate = sampleRate;
 }
 
+// Solve the system again at another rate while playing, keeping the state of the circuit:
+// the node voltages and the currents of the reactive components don't depend on the rate
+void Netlist::change_sample_rate(double newSampleRate) {
+    setSampleRate(newSampleRate);
+    A.setZero();
+    b.setZero();
+    solve_system();
+}
+
 void Netlist::prepareChannels(int numChannels) {
     channelBStates.resize(numChannels, b);
     channelXStates.resize(numChannels, x);
+    channelXPrevStates.resize(numChannels, xPrev);
+}
+
+void Netlist::loadChannelState(int channel) {
+    b = channelBStates[channel];
+    x = channelXStates[channel];
+    xPrev = channelXPrevStates[channel];
+}
+
+void Netlist::saveChannelState(int channel) {
+    channelBStates[channel] = b;
+    channelXStates[channel] = x;
+    channelXPrevStates[channel] = xPrev;
+}
+
+
+// Snapshot layout: magic, version, structure hash, n, m, number of channels (as uint64),
+// then x, xPrev and b for each channel, then the voltage of each reactive component (as double)
+static constexpr uint64_t stateMagic = 0x4d4e417374617465;   // "MNAstate"
+static constexpr uint64_t stateVersion = 1;
+
+std::vector<char> Netlist::saveState() const {
+    const uint64_t header[6] = { stateMagic, stateVersion, getStructureHash(), n, m, channelXStates.size() };
+    const size_t size = n + m;
+
+    std::vector<char> data(sizeof(header) + sizeof(double) * (3 * size * channelXStates.size() + reactiveComponents.size()));
+    char* write = data.data();
+    auto append = [&write](const void* source, size_t bytes) {
+        std::memcpy(write, source, bytes);
+        write += bytes;
+    };
+
+    append(header, sizeof(header));
+    for (size_t channel = 0; channel < channelXStates.size(); channel++) {
+        append(channelXStates[channel].data(), sizeof(double) * size);
+        append(channelXPrevStates[channel].data(), sizeof(double) * size);
+        append(channelBStates[channel].data(), sizeof(double) * size);
+    }
+    for (const auto& comp : reactiveComponents) append(&comp->voltage, sizeof(double));
+    return data;
+}
+
+// Restore a snapshot taken by saveState. Channels missing from the snapshot keep their state.
+// Returns false, leaving the state untouched, if the snapshot doesn't match this netlist
+bool Netlist::restoreState(const char* data, size_t sizeInBytes) {
+    uint64_t header[6];
+    if (!isInitialized || sizeInBytes < sizeof(header)) return false;
+    std::memcpy(header, data, sizeof(header));
+
+    const size_t size = n + m;
+    const size_t numChannels = size_t(header[5]);
+    if (header[0] != stateMagic || header[1] != stateVersion || header[2] != getStructureHash()
+        || header[3] != n || header[4] != m
+        || sizeInBytes != sizeof(header) + sizeof(double) * (3 * size * numChannels + reactiveComponents.size())) {
+        return false;
+    }
+
+    const char* read = data + sizeof(header);
+    auto extract = [&read](void* destination, size_t bytes) {
+        std::memcpy(destination, read, bytes);
+        read += bytes;
+    };
+
+    Eigen::VectorXd skipped(size);
+    for (size_t channel = 0; channel < numChannels; channel++) {
+        const bool kept = channel < channelXStates.size();
+        extract(kept ? channelXStates[channel].data() : skipped.data(), sizeof(double) * size);
+        extract(kept ? channelXPrevStates[channel].data() : skipped.data(), sizeof(double) * size);
+        extract(kept ? channelBStates[channel].data() : skipped.data(), sizeof(double) * size);
+    }
+    for (const auto& comp : reactiveComponents) extract(&comp->voltage, sizeof(double));
+
+    if (!channelXStates.empty()) loadChannelState(0);
+    return true;
+}
+
+// Whether other has the same components, in the same order and on the same nodes, with the same integration
+// method: it then only differs by the values of its components (or their parameters), and can take over the
+// state of this netlist (see copyStateFrom)
+bool Netlist::hasSameTopology(const Netlist& other) const {
+    if (!isInitialized || !other.isInitialized || n != other.n || m != other.m
+        || components.size() != other.components.size() || integrationMethod != other.integrationMethod) {
+        return false;
+    }
+    for (size_t k = 0; k < components.size(); k++) {
+        if (typeid(*components[k]) != typeid(*other.components[k])) return false;
+
+        const auto terminals = components[k]->getTerminals();
+        const auto otherTerminals = other.components[k]->getTerminals();
+        if (terminals.size() != otherTerminals.size()) return false;
+        for (size_t j = 0; j < terminals.size(); j++) {
+            if (*terminals[j] != *otherTerminals[j]) return false;
+        }
+    }
+    for (size_t j = 0; j < potentiometers.size(); j++) {
+        if (potentiometers[j]->knob != other.potentiometers[j]->knob) return false;
+    }
+    return true;
+}
+
+// Continue from the state of a netlist with the same topology (see hasSameTopology), after an edit of the
+// values: the unknowns and the previous input of each channel, the sources of the reactive components, and what
+// the strategy keeps (the inputs of a convolution), once it has brought the state of other up to date.
+// Doesn't allocate, so that the audio thread can call it when it switches to the edited netlist
+void Netlist::copyStateFrom(Netlist& other) {
+    other.processStrategy->flushState(other);
+    const size_t numChannels = std::min(channelXStates.size(), other.channelXStates.size());
+    for (size_t channel = 0; channel < numChannels; channel++) {
+        channelXStates[channel] = other.channelXStates[channel];
+        channelXPrevStates[channel] = other.channelXPrevStates[channel];
+        //the other rows of b are stamped from the (edited) sources at each sample
+        for (const auto& source : voltageSources) {
+            if (dynamic_cast<ExternalVoltageSource*>(source.get()) != nullptr) {
+                channelBStates[channel](n + source->index) = other.channelBStates[channel](n + source->index);
+            }
+        }
+    }
+    for (size_t k = 0; k < reactiveComponents.size(); k++) {
+        reactiveComponents[k]->voltage = other.reactiveComponents[k]->voltage;
+    }
+    if (numChannels > 0) loadChannelState(0);
+    //the input history kept by a strategy only holds at the rate it was taken at
+    if (other.sampleRate == sampleRate) processStrategy->copyStateFrom(*other.processStrategy);
+}
+
+// FNV-1a hash of the nodes and values of the components, identifying a netlist
+uint64_t Netlist::getStructureHash() const {
+    uint64_t hash = 0xcbf29ce484222325;
+    auto combine = [&hash](const void* source, size_t bytes) {
+        const auto* bytesToHash = static_cast<const unsigned char*>(source);
+        for (size_t k = 0; k < bytes; k++) {
+            hash ^= bytesToHash[k];
+            hash *= 0x100000001b3;
+        }
+    };
+
+    combine(&n, sizeof(n));
+    combine(&m, sizeof(m));
+    for (const auto& comp : components) {
+        for (auto* node : comp->getTerminals()) combine(node, sizeof(unsigned));
+        //the voltage probes keep their last reading in value
+        if (dynamic_cast<VoltageProbe*>(comp.get()) == nullptr) combine(&comp->value, sizeof(double));
+    }
+    return hash;
+}
+
+
+// Hash of everything the per-sample map of a linear netlist depends on besides the sample rate and the knobs:
+// the structure, the types of the components, the knobs driving the potentiometers, the integration method
+// and the precision of the solve. Netlists with the same content hash compute the same thing
+uint64_t Netlist::getContentHash() const {
+    uint64_t hash = getStructureHash();
+    auto combine = [&hash](const void* source, size_t bytes) {
+        const auto* bytesToHash = static_cast<const unsigned char*>(source);
+        for (size_t k = 0; k < bytes; k++) {
+            hash ^= bytesToHash[k];
+            hash *= 0x100000001b3;
+        }
+    };
+
+    for (const auto& comp : components) {
+        const std::string type = typeid(*comp).name();
+        combine(type.data(), type.size());
+    }
+    for (const auto& pot : potentiometers) {
+        combine(&pot->knob, sizeof(pot->knob));
+        combine(&pot->minValue, sizeof(pot->minValue));
+    }
+    combine(&numIntegrationStages, sizeof(numIntegrationStages));
+    combine(integrationStages, sizeof(IntegrationStage) * numIntegrationStages);
+    combine(&activePrecision, sizeof(activePrecision));
+    return hash;
+}
+
+// Integration formulas of the reactive components (see IntegrationStage). All the stages
+// share the same beta0, hence the same companion resistances and the same factorized A.
+// TR-BDF2 uses gamma = 2 - sqrt(2) for that reason
+void Netlist::setIntegrationMethod(IntegrationMethod method, double theta) {
+    integrationMethod = method;
+    numIntegrationStages = 1;
+
+    switch (method) {
+    case IntegrationMethod::BackwardEuler:
+        integrationStages[0] = { 1.0, 0.0, 1.0, 0.0, 1.0 };
+        break;
+    case IntegrationMethod::DampedTrapezoidal:
+        integrationStages[0] = { theta, 1.0 - theta, 1.0, 0.0, 1.0 };
+        break;
+    case IntegrationMethod::BDF2:
+        integrationStages[0] = { 2.0 / 3.0, 0.0, 4.0 / 3.0, -1.0 / 3.0, 1.0 };
+        break;
+    case IntegrationMethod::TRBDF2: {
+        const double gamma = 2.0 - std::sqrt(2.0);
+        const double scale = 1.0 / (gamma * (2.0 - gamma));
+        integrationStages[0] = { gamma / 2.0, gamma / 2.0, 1.0, 0.0, gamma };
+        integrationStages[1] = { (1.0 - gamma) / (2.0 - gamma), 0.0, scale, -(1.0 - gamma) * (1.0 - gamma) * scale, 1.0 };
+        numIntegrationStages = 2;
+        break;
+    }
+    default:
+        integrationStages[0] = { 0.5, 0.5, 1.0, 0.0, 1.0 };
+    }
+}
+
+
+// Stamp the sources and the history of the reactive components before solving one integration stage.
+// The input is interpolated between the previous sample and this one for the intermediate stages
+void Netlist::begin_stage(unsigned stage, double input) {
+    const auto& coefficients = integrationStages[stage];
+
+    for (auto& source : voltageSources) {
+        if (auto* externalSource = dynamic_cast<ExternalVoltageSource*>(source.get())) {
+            const double previous = b(n + source->index);
+            externalSource->update(previous + coefficients.timeFraction * (input - previous));
+        }
+        source->stamp(*this);
+    }
+    for (auto& comp : reactiveComponents) {
+        comp->updateVoltage(*this, coefficients);
+        comp->stamp(*this);
+    }
+    xPrev = x;
 }
 
 
 //====================================================================================================
 //====================================================================================================
 // Calculate the total number of unique nodes (including ground)
-// Very simple implementation, not optimized and don't deal with the case of disconnected components
+// After renumberNodes, this is also the highest node number + 1
 unsigned Netlist::getNodeNbr() {
     std::unordered_set<unsigned> nodes;
     for (const auto& comp : components) {
-        nodes.insert(comp->start_node);
-        nodes.insert(comp->end_node);
+        for (auto* node : comp->getTerminals()) nodes.insert(*node);
     }
     return nodes.size();
 }
 
 
+// Renumber the nodes from 0 to n-1 (0 staying the ground), since the components index A
+// directly by their node numbers: gaps in the numbering of the netlist would otherwise leave
+// empty rows in A. The nodes are taken in reverse Cuthill-McKee order, so that connected
+// nodes get close numbers and the non-zero entries of A stay near the diagonal
+void Netlist::renumberNodes() {
+    std::map<unsigned, unsigned> compact = { { 0, 0 } };
+    for (const auto& comp : components) {
+        for (auto* node : comp->getTerminals()) {
+            compact.emplace(*node, unsigned(compact.size()));
+        }
+    }
+
+    //graph of the non ground nodes, node k being vertex k-1
+    std::vector<std::vector<unsigned>> adjacency(compact.size() - 1);
+    for (const auto& comp : components) {
+        const auto terminals = comp->getTerminals();
+        for (auto* lhs : terminals) {
+            for (auto* rhs : terminals) {
+                const unsigned u = compact[*lhs], v = compact[*rhs];
+                if (u == 0 || v == 0 || u == v) continue;
+                auto& neighbours = adjacency[u - 1];
+                if (std::find(neighbours.begin(), neighbours.end(), v - 1) == neighbours.end()) neighbours.push_back(v - 1);
+            }
+        }
+    }
+
+    const auto order = reverseCuthillMcKee(adjacency);
+    std::vector<unsigned> newNode(compact.size(), 0);
+    for (unsigned k = 0; k < order.size(); k++) newNode[order[k] + 1] = k + 1;
+
+    for (const auto& comp : components) {
+        for (auto* node : comp->getTerminals()) {
+            *node = newNode[compact[*node]];
+        }
+    }
+
+    std::unordered_map<unsigned, size_t> renumberedKeys;
+    for (const auto& [node, key] : subcircuitNodeKeys) {
+        const auto found = compact.find(node);
+        if (found != compact.end()) renumberedKeys[newNode[found->second]] = key;
+    }
+    subcircuitNodeKeys = std::move(renumberedKeys);
+}
+
+
+// Columns of the non-zero entries of each row of the reduced A matrix. The nonlinear components
+// are added explicitly, since their conductances may be zero at the time the system is stamped
+std::vector<std::vector<unsigned>> Netlist::getSparsityPattern() const {
+    const auto size = A.rows() - 1;
+    std::vector<std::vector<unsigned>> pattern(size);
+
+    for (unsigned i = 0; i < size; i++) {
+        for (unsigned j = 0; j < size; j++) {
+            if (A(i + 1, j + 1) != 0.0) pattern[i].push_back(j);
+        }
+    }
+    for (const auto& comp : nonlinearComponents) {
+        const auto terminals = comp->getTerminals();
+        for (auto* row : terminals) {
+            for (auto* col : terminals) {
+                if (*row == 0 || *col == 0) continue;
+                auto& cols = pattern[*row - 1];
+                if (std::find(cols.begin(), cols.end(), *col - 1) == cols.end()) cols.push_back(*col - 1);
+            }
+        }
+    }
+    return pattern;
+}
+
+
+// Key of each row and unknown of the reduced system. The corresponding rows of two instances of
+// a subcircuit get the same key, so that the block solver can order their blocks alike and
+// share their factorization. The other rows get keys of their own
+std::vector<size_t> Netlist::getInstanceKeys() {
+    std::vector<size_t> keys(A.rows() - 1);
+
+    auto nodeKey = [this](unsigned node) {
+        const auto found = subcircuitNodeKeys.find(node);
+        return found != subcircuitNodeKeys.end() ? found->second : ~size_t(node);
+    };
+    auto branchKey = [&](Component& comp, size_t kind) {
+        size_t key = kind;
+        for (auto* node : comp.getTerminals()) key = key * 1000003 ^ nodeKey(*node);
+        return key;
+    };
+
+    for (unsigned node = 1; node < n; node++) keys[node - 1] = nodeKey(node);
+    for (const auto& source : voltageSources)    keys[n - 1 + source->index] = branchKey(*source, 1);
+    for (const auto& comp : reactiveComponents)  keys[n - 1 + comp->index] = branchKey(*comp, 2);
+    for (const auto& opa : idealOPAs)            keys[n - 1 + opa->index] = branchKey(*opa, 3);
+    return keys;
+}
+
+
 //====================================================================================================
 //====================================================================================================
-std::vector<std::string> Netlist::split(const std::string& s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+// Netlist options, one per line starting with a dot:
+// .method be|trap|dtrap [theta]|bdf2|trbdf2     discretization of the reactive components
+// .precision auto|double|single|mixed          precision of the per-sample solve of linear circuits
+// .operator on|off                             use of the explicit solution operator when it is cheaper
+// .convolution [tolerance]                     apply the impulse response of a linear circuit (ConvolutionProcessStrategy)
+// .model <name> <type>(<name>=<value> ...)     parameters shared by the components using the model
+// .subckt <name> <ports...> ... .ends          subcircuit definition (see createComponentList)
+void Netlist::parseDirective(const NetlistLine& line) {
+    const auto directive = toLower(line.symbol);
+
+    if (directive == ".method" && !line.arguments.empty()) {
+        const auto name = toLower(line.arguments[0]);
+        if (name == "be")          setIntegrationMethod(IntegrationMethod::BackwardEuler);
+        else if (name == "trap")   setIntegrationMethod(IntegrationMethod::Trapezoidal);
+        else if (name == "dtrap")  setIntegrationMethod(IntegrationMethod::DampedTrapezoidal, line.arguments.size() > 1 ? parseValue(line.arguments[1]) : 0.55);
+        else if (name == "bdf2")   setIntegrationMethod(IntegrationMethod::BDF2);
+        else if (name == "trbdf2") setIntegrationMethod(IntegrationMethod::TRBDF2);
+        else throw std::runtime_error("Unknown integration method: " + name);
+    }
+    else if (directive == ".precision" && !line.arguments.empty()) {
+        const auto name = toLower(line.arguments[0]);
+        if (name == "auto")        setPrecision(Precision::Auto);
+        else if (name == "double") setPrecision(Precision::Double);
+        else if (name == "single") setPrecision(Precision::Single);
+        else if (name == "mixed")  setPrecision(Precision::Mixed);
+        else throw std::runtime_error("Unknown precision: " + name);
+    }
+    else if (directive == ".operator" && !line.arguments.empty()) {
+        const auto name = toLower(line.arguments[0]);
+        if (name == "on")       setSolveOperatorAllowed(true);
+        else if (name == "off") setSolveOperatorAllowed(false);
+        else throw std::runtime_error("Unknown operator setting: " + name);
+    }
+    else if (directive == ".convolution") {
+        convolutionRequested = true;
+        linearStrategy = LinearStrategy::Convolution;
+        if (!line.arguments.empty()) convolutionTolerance = parseValue(line.arguments[0]);
+    }
+    else if (directive == ".model" && line.arguments.size() > 1) {
+        models[toLower(line.arguments[0])] = { toLower(line.arguments[1]), line.parameters };
+    }
+    else {
+        throw std::runtime_error("Unknown directive: " + line.symbol);
     }
-    return tokens;
 }
 
 
-// Factory method to create components from a definition string
-std::shared_ptr<Component> Netlist::createComponent(const std::string& netlistLine, unsigned idx) {
-    auto tokens = split(netlistLine, ' ');
-    std::string symbol = tokens[0];
-    unsigned start_node = std::stoi(tokens[1]);
-    unsigned end_node = std::stoi(tokens[2]);
-    double value = std::stod(tokens[3]);
+// Components are allocated from componentArena, with their reference counts
+// Bytes allocate_shared takes from the arena for the largest component: the object, its reference counts,
+// the allocator and the alignment padding
+static constexpr size_t componentArenaBlockBytes = std::max({ sizeof(Resistance), sizeof(Potentiometer), sizeof(Capacitor),
+    sizeof(Inductance), sizeof(VoltageSource), sizeof(ExternalVoltageSource), sizeof(VoltageProbe), sizeof(CurrentSource),
+    sizeof(IdealOPA), sizeof(Diode), sizeof(BJT), sizeof(JFET), sizeof(TanhVCCS) }) + 64;
+
+// Components added by addOpAmpMacromodel
+static constexpr size_t opAmpMacromodelSize = 5;
+
+template <typename T, typename... Args>
+std::shared_ptr<T> Netlist::makeComponent(Args&&... args) {
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(componentArena.get()), std::forward<Args>(args)...);
+}
+
+
+// Factory method to create components from a netlist line:
+// <symbol> <node> <node> [<node>] [<value>|<flag>|<model>] [<name>=<value> ...]
+std::shared_ptr<Component> Netlist::createComponent(const NetlistLine& line, unsigned idx) {
+    const std::string& symbol = line.symbol;
+    const char type = char(std::toupper(static_cast<unsigned char>(symbol[0])));
+    const char subtype = symbol.size() > 1 ? char(std::tolower(static_cast<unsigned char>(symbol[1]))) : '\0';
+    const unsigned numTerminals = (type == 'Q' || type == 'J' || type == 'O') ? 3 : 2;
+
+    if (line.arguments.size() < numTerminals) {
+        throw std::runtime_error("Missing node in: " + symbol);
+    }
+    unsigned nodes[3] = {};
+    for (unsigned k = 0; k < numTerminals; k++) {
+        if (!isValue(line.arguments[k])) throw std::runtime_error("Invalid node " + line.arguments[k] + " in: " + symbol);
+        nodes[k] = unsigned(std::stoul(line.arguments[k]));
+    }
+
+    //the argument after the nodes is the value, or a flag or a model name for the semiconductors
+    const std::string option = line.arguments.size() > numTerminals ? line.arguments[numTerminals] : std::string();
+    auto getValue = [&]() {
+        if (!isValue(option)) throw std::runtime_error("Missing value in: " + symbol);
+        return parseValue(option);
+    };
+    const ModelCard* model = nullptr;
+    if (!option.empty()) {
+        //model names may start with a digit (1N4148, 2N3904), so they are looked up before values
+        const auto found = models.find(toLower(option));
+        if (found != models.end()) model = &found->second;
+    }
+    //flag or model type of the semiconductors: npn/pnp, n/p (njf/pjf) or d
+    const auto kind = model != nullptr ? model->type : toLower(option);
+    auto checkKind = [&](bool isKnown) {
+        if (!isKnown) throw std::runtime_error("Unknown model " + option + " in: " + symbol);
+    };
+
+    std::shared_ptr<Component> component;
 
     // Depending on the symbol, instantiate the appropriate component
-    switch (symbol[0]) {
+    switch (type) {
     case 'V':
-        if (symbol[1] == 'i') {
-            return std::make_shared<ExternalVoltageSource>(start_node, end_node, value, idx);
+        if (subtype == 'i') {
+            component = makeComponent<ExternalVoltageSource>(nodes[0], nodes[1], isValue(option) ? parseValue(option) : 0.0, idx);
         }
-        else if (symbol[1] == 'o') {
-            return std::make_shared<VoltageProbe>(start_node, end_node);
+        else if (subtype == 'o') {
+            component = makeComponent<VoltageProbe>(nodes[0], nodes[1]);
         }
         else {
-            return std::make_shared<VoltageSource>(start_node, end_node, value, idx);
+            component = makeComponent<VoltageSource>(nodes[0], nodes[1], getValue(), idx);
         }
+        break;
     case 'R':
-        return std::make_shared<Resistance>(start_node, end_node, value);
+        component = makeComponent<Resistance>(nodes[0], nodes[1], getValue());
+        break;
+    case 'P':
+        //the digits following the symbol select the knob (P1 ... P4), knob 1 by default
+        component = makeComponent<Potentiometer>(nodes[0], nodes[1], getValue(),
+            std::isdigit(static_cast<unsigned char>(subtype)) ? std::clamp(std::stoi(symbol.substr(1)), 1, numKnobs) - 1 : 0);
+        break;
     case 'C':
-        return std::make_shared<Capacitor>(start_node, end_node, value, idx);
+        component = makeComponent<Capacitor>(nodes[0], nodes[1], getValue(), idx);
+        break;
     case 'L':
-        return std::make_shared<Inductance>(start_node, end_node, value, idx);
+        component = makeComponent<Inductance>(nodes[0], nodes[1], getValue(), idx);
+        break;
     case 'I':
-        return std::make_shared<CurrentSource>(start_node, end_node, value);
+        component = makeComponent<CurrentSource>(nodes[0], nodes[1], getValue());
+        break;
     case 'O':
-        return std::make_shared<IdealOPA>(start_node, end_node, value, idx);
+        component = makeComponent<IdealOPA>(nodes[0], nodes[1], nodes[2], idx);
+        break;
     case 'D':
-        return std::make_shared<Diode>(start_node, end_node);
+        checkKind(model != nullptr ? kind == "d" : option.empty() || isValue(option));
+        component = makeComponent<Diode>(nodes[0], nodes[1]);
+        break;
+    case 'Q':
+        checkKind(option.empty() || kind == "npn" || kind == "pnp");
+        component = makeComponent<BJT>(nodes[0], nodes[1], nodes[2], kind == "pnp" ? -1.0 : 1.0);
+        break;
+    case 'J':
+        checkKind(option.empty() || kind == "n" || kind == "njf" || kind == "p" || kind == "pjf");
+        component = makeComponent<JFET>(nodes[0], nodes[1], nodes[2], kind == "p" || kind == "pjf" ? -1.0 : 1.0);
+        break;
     default:
         throw std::runtime_error("Unknown component symbol: " + symbol);
     }
+
+    //parameters of the model first, so that the ones given on the line override them
+    if (model != nullptr) {
+        for (const auto& [name, parameterValue] : model->parameters) component->setParameter(name, parameterValue);
+    }
+    for (const auto& [name, parameterValue] : line.parameters) component->setParameter(name, parameterValue);
+
+    return component;
 }
 
-std::vector<std::shared_ptr<Component>> Netlist::createComponentListFromTxt(const std::string& filename) {
+std::vector<std::shared_ptr<Component>> Netlist::createComponentList(const std::string& text) {
     std::vector<std::shared_ptr<Component>> components;
-    std::ifstream netlistTxt(filename);
-    std::string line;
-    unsigned idx = 0;
 
-    if (netlistTxt.is_open()) {
-        while (std::getline(netlistTxt, line)) {
-            if (!line.empty()) {
-                auto component = createComponent(line, idx);
-                if (dynamic_cast<VoltageSource*>(component.get()) != nullptr ||
-                    dynamic_cast<ReactiveComponent*>(component.get()) != nullptr ||
-                    dynamic_cast<IdealOPA*>(component.get()) != nullptr) {
-                    idx++;
-                }
-                if (component) {
-                    components.push_back(std::move(component));
-                }
+    std::vector<NetlistLine> lines;
+    NetlistLine line;
+    Subcircuit* definition = nullptr;
+    models.clear();
+    subcircuits.clear();
+    subcircuitNodeKeys.clear();
+
+    //the directives are applied first, so that a .model card or a .subckt may follow the components using it
+    for (size_t start = 0; start < text.size();) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+
+        if (parseLine(std::string_view(text).substr(start, end - start), line)) {
+            const auto directive = toLower(line.symbol);
+            if (directive == ".subckt") {
+                if (definition != nullptr) throw std::runtime_error("Nested .subckt definition");
+                if (line.arguments.empty()) throw std::runtime_error("Missing .subckt name");
+                const auto name = toLower(line.arguments[0]);
+                definition = &subcircuits[name];
+                *definition = { name, { line.arguments.begin() + 1, line.arguments.end() }, {} };
             }
+            else if (directive == ".ends") {
+                if (definition == nullptr) throw std::runtime_error(".ends without .subckt");
+                definition = nullptr;
+            }
+            else if (line.symbol[0] == '.') parseDirective(line);
+            else if (definition != nullptr) definition->lines.push_back(std::move(line));
+            else lines.push_back(std::move(line));
         }
-        netlistTxt.close();
+        start = end + 1;
     }
-    else {
-        std::cout << "Unable to open the netlist file" << std::endl;
+    if (definition != nullptr) throw std::runtime_error("Missing .ends for " + definition->name);
+
+    //the nodes added at load time are numbered from the highest node of the netlist up
+    unsigned highestNode = 0;
+    for (const auto& componentLine : lines) {
+        const auto numTerminals = std::min<size_t>(getNumTerminals(componentLine), componentLine.arguments.size());
+        for (size_t k = 0; k < numTerminals; k++) {
+            const auto& node = componentLine.arguments[k];
+            if (!node.empty() && std::all_of(node.begin(), node.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+                highestNode = std::max(highestNode, unsigned(std::stoul(node)));
+            }
+        }
+    }
+    nextInternalNode = highestNode + 1;
+
+    //subcircuit instances are replaced by the lines of their definition
+    std::vector<NetlistLine> flatLines;
+    flatLines.reserve(lines.size());
+    for (auto& componentLine : lines) {
+        if (std::toupper(static_cast<unsigned char>(componentLine.symbol[0])) == 'X') expandSubcircuit(componentLine, flatLines, 0);
+        else flatLines.push_back(std::move(componentLine));
+    }
+    lines = std::move(flatLines);
+
+    //sized for the components the lines expand to: a diode may add its series resistance, an op-amp is a macromodel
+    size_t numComponents = 0;
+    for (const auto& componentLine : lines) {
+        const char type = char(std::toupper(static_cast<unsigned char>(componentLine.symbol[0])));
+        numComponents += type == 'U' ? opAmpMacromodelSize : type == 'D' ? 2 : 1;
+    }
+    componentArena = std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(numComponents, 1) * componentArenaBlockBytes);
+
+    unsigned idx = 0;
+    for (const auto& componentLine : lines) {
+        if (std::toupper(static_cast<unsigned char>(componentLine.symbol[0])) == 'U') {
+            addOpAmpMacromodel(componentLine, components, idx);
+            continue;
+        }
+        auto component = createComponent(componentLine, idx);
+
+        //the series resistance of a diode goes between its anode and an internal node
+        if (auto* diode = dynamic_cast<Diode*>(component.get()); diode != nullptr && diode->Rs > 0) {
+            const unsigned internal = nextInternalNode++;
+            components.push_back(makeComponent<Resistance>(diode->start_node, internal, diode->Rs));
+            diode->start_node = internal;
+        }
+        if (dynamic_cast<VoltageSource*>(component.get()) != nullptr ||
+            dynamic_cast<ReactiveComponent*>(component.get()) != nullptr ||
+            dynamic_cast<IdealOPA*>(component.get()) != nullptr) {
+            idx++;
+        }
+        if (component) {
+            components.push_back(std::move(component));
+        }
     }
     return components;
-}
\ No newline at end of file
+}
+
+
+// Op-amp macromodel (defaults of a TL072): U in+ in- out [rail voltage] [a0= gbw= sr= rout=]
+// A transconductance input stage, saturating at the slew rate current, drives the dominant pole
+// (gain-bandwidth) on an internal node. The output stage is a Norton source clipping at the rails,
+// in parallel with the output resistance
+void Netlist::addOpAmpMacromodel(const NetlistLine& line, std::vector<std::shared_ptr<Component>>& components, unsigned& idx) {
+    constexpr double poleCapacitance = 1e-9;
+    double openLoopGain = 2e5;
+    double gainBandwidth = 3e6;
+    double slewRate = 13e6;
+    double outputResistance = 75;
+    double rail = 13.5;
+
+    if (line.arguments.size() < 3) throw std::runtime_error("Missing node in: " + line.symbol);
+    const unsigned inp = unsigned(std::stoul(line.arguments[0]));
+    const unsigned inn = unsigned(std::stoul(line.arguments[1]));
+    const unsigned out = unsigned(std::stoul(line.arguments[2]));
+    if (line.arguments.size() > 3) rail = parseValue(line.arguments[3]);
+
+    for (const auto& [name, parameterValue] : line.parameters) {
+        if (name == "a0")        openLoopGain = parameterValue;
+        else if (name == "gbw")  gainBandwidth = parameterValue;
+        else if (name == "sr")   slewRate = parameterValue;
+        else if (name == "rout") outputResistance = parameterValue;
+        else if (name == "rail") rail = parameterValue;
+        else throw std::runtime_error("Unknown parameter: " + name);
+    }
+
+    //internal node, out of the range of the netlist nodes; renumberNodes compacts it afterwards
+    const unsigned internal = nextInternalNode++;
+
+    const double gm = 2 * juce::MathConstants<double>::pi * gainBandwidth * poleCapacitance;
+    components.push_back(makeComponent<TanhVCCS>(0, internal, inp, inn, gm, slewRate * poleCapacitance));
+    components.push_back(makeComponent<Resistance>(internal, 0, openLoopGain / gm));
+    components.push_back(makeComponent<Capacitor>(internal, 0, poleCapacitance, idx++));
+    components.push_back(makeComponent<TanhVCCS>(0, out, internal, 0, 1 / outputResistance, rail / outputResistance));
+    components.push_back(makeComponent<Resistance>(out, 0, outputResistance));
+}
+
+
+// Instance of a subcircuit: X<name> <nodes...> <subcircuit name>
+// The ports are connected to the nodes of the instance, node 0 stays the ground, and every other
+// node of the definition (which may be named rather than numbered) gets a new node number
+void Netlist::expandSubcircuit(const NetlistLine& instance, std::vector<NetlistLine>& lines, unsigned depth) {
+    if (instance.arguments.empty()) throw std::runtime_error("Missing subcircuit name in: " + instance.symbol);
+    if (depth > 16) throw std::runtime_error("Recursive subcircuit in: " + instance.symbol);
+
+    const auto found = subcircuits.find(toLower(instance.arguments.back()));
+    if (found == subcircuits.end()) throw std::runtime_error("Unknown subcircuit " + instance.arguments.back() + " in: " + instance.symbol);
+    const auto& definition = found->second;
+    if (definition.ports.size() != instance.arguments.size() - 1) {
+        throw std::runtime_error("Wrong number of nodes for " + definition.name + " in: " + instance.symbol);
+    }
+
+    std::unordered_map<std::string, std::string> nodeNames = { { "0", "0" } };
+    for (size_t k = 0; k < definition.ports.size(); k++) nodeNames[definition.ports[k]] = instance.arguments[k];
+
+    for (const auto& definitionLine : definition.lines) {
+        auto line = definitionLine;
+
+        const auto numTerminals = std::min<size_t>(getNumTerminals(definitionLine), line.arguments.size());
+        for (size_t k = 0; k < numTerminals; k++) {
+            auto& node = line.arguments[k];
+            auto name = nodeNames.find(node);
+            if (name == nodeNames.end()) {
+                const unsigned number = nextInternalNode++;
+                subcircuitNodeKeys[number] = std::hash<std::string>()(definition.name + "." + node);
+                name = nodeNames.emplace(node, std::to_string(number)).first;
+            }
+            node = name->second;
+        }
+
+        if (std::toupper(static_cast<unsigned char>(definitionLine.symbol[0])) == 'X') expandSubcircuit(line, lines, depth + 1);
+        else lines.push_back(std::move(line));
+    }
+}
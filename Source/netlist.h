@@ -2,13 +2,22 @@
 #pragma once
 #include "JuceHeader.h"
 #include "processStartegy.h"
+#include "modelCache.h"
+#include "knobGrid.h"
+#include "blockSolver.h"
+#include "bandedSolver.h"
+#include "deviceBank.h"
+#include "netlistParser.h"
 #include <Eigen/Dense>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <unordered_set>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <memory_resource>
+#include <unordered_map>
 
 
 
@@ -16,6 +25,7 @@
 // Forward declarations to avoid circular dependencies
 class Component;
 class Resistance;
+class Potentiometer;
 class ReactiveComponent;
 class Capacitor;
 class Inductance;
@@ -28,49 +38,188 @@ class Diode;
 
 class Netlist {//: public std::enable_shared_from_this<Netlist> 
 public:
+    // Arena the components are allocated from when the netlist is loaded, together with their reference counts:
+    // they sit next to each other in netlist order, and are freed at once. Declared before the lists so that it
+    // outlives them
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> componentArena;
+
     std::vector<std::shared_ptr<Component>> components;
     std::vector<std::shared_ptr<Resistance>> resistances;
+    std::vector<std::shared_ptr<Potentiometer>> potentiometers;
     std::vector<std::shared_ptr<ReactiveComponent>> reactiveComponents;
     std::vector<std::shared_ptr<IdealOPA>> idealOPAs;
     std::vector<std::shared_ptr<VoltageSource>> voltageSources;
     std::vector<std::shared_ptr<CurrentSource>> currentSources;
     std::vector<std::shared_ptr<VoltageProbe>> voltageProbes;
     std::vector<std::shared_ptr<Diode>> diodes;
+    std::vector<std::shared_ptr<Component>> nonlinearComponents;   // diodes, transistors, macromodel stages
+
+    // .model cards and .subckt definitions of the netlist, by lower case name
+    std::unordered_map<std::string, ModelCard> models;
+    std::unordered_map<std::string, Subcircuit> subcircuits;
+    // Nodes created for the subcircuit instances, keyed by subcircuit and local node name,
+    // so that the corresponding nodes of identical instances can be matched
+    std::unordered_map<unsigned, size_t> subcircuitNodeKeys;
+    unsigned nextInternalNode = 0;  // next node number for the nodes added at load time, above the netlist ones
+
+    // Batched evaluation of the transistors and of the saturating sources
+    DeviceBank deviceBank;
 
     Eigen::MatrixXd A;
     Eigen::VectorXd x, b;
     Eigen::PartialPivLU<Eigen::MatrixXd> luDecomp;
 
+    // Way the system is factorized and solved, chosen when the system is first solved
+    // from the structure of A (see choose_solver)
+    enum class SolverMode { DenseLU, Blocks, Banded };
+    SolverMode solverMode = SolverMode::DenseLU;
+    BlockSolver blockSolver;    // for circuits splitting into several one-way coupled blocks
+    BandedSolver bandedSolver;  // for ladder-like circuits with a narrow-band matrix
+    double solveCost = 0;       // multiply-adds per solve with the chosen solver
+    bool solverOverridden = false;                  // set by the strategy selector, to use solverOverride
+    SolverMode solverOverride = SolverMode::DenseLU; // instead of the cheapest solver of the cost model
+
+    // Strategy installed by initializeProcessStrategy for linear circuits (see StrategySelector)
+    enum class LinearStrategy { PerSample, Block, Convolution };
+    LinearStrategy linearStrategy = LinearStrategy::Block;
+
+    // Precision of the per-sample solve of linear circuits, set with a ".precision" line.
+    // Single solves with factors computed in float, Mixed with the double factors rounded to float;
+    // both use the dense LU (or the knob grid kernel), which runs twice as many lanes in float.
+    // Double unless asked for: Auto picks Mixed when it is cheaper, A isn't badly conditioned
+    // and a simulated run in float stays within -100 dB of the double one
+    enum class Precision { Auto, Double, Single, Mixed };
+    Precision precision = Precision::Double;
+    Precision activePrecision = Precision::Double;
+    Eigen::MatrixXf luFactorsSingle;                        // L (unit lower) and U of the float solve
+    Eigen::VectorXi luRowOrder;                             // row permutation of the float solve
+    Eigen::VectorXf bSingle, xSingle;
+
+    // Explicit solution operator of linear circuits: the rows of A^-1 for the unknowns read after
+    // each solve (probes, reactive components, potentiometers), restricted to the columns of b
+    // the sources write. When it is cheaper than the chosen solver, a sample costs one GEMV
+    Eigen::MatrixXd solveOperator;
+    Eigen::MatrixXd solveOperatorPotW;          // rows of potW for operatorRows
+    std::vector<unsigned> operatorRows;         // indices in x of the rows of solveOperator
+    std::vector<unsigned> operatorColumns;      // indices in b of the columns of solveOperator
+    Eigen::VectorXd operatorInput, operatorOutput;
+    bool solveOperatorAllowed = true;           // cleared with ".operator off"
+    bool solveOperatorActive = false;
+
+    // Low-rank correction of luDecomp when potentiometers move (Woodbury identity).
+    // luDecomp stays factorized at the reference admittances, and each solve is corrected by
+    // x = y - W * (I + D*C)^-1 * D * U^T * y, with y the uncorrected solution.
+    Eigen::MatrixXd potW;               // A0^-1 * U, one column per potentiometer
+    Eigen::MatrixXd potC;               // U^T * A0^-1 * U
+    Eigen::MatrixXd potCorrection;      // (I + D*C)^-1 * D
+    Eigen::VectorXd potReference;       // admittances stamped in luDecomp
+    Eigen::VectorXd potDelta;           // D, admittance offsets from the reference
+    Eigen::VectorXd potProjection;      // U^T * y
+    Eigen::PartialPivLU<Eigen::MatrixXd> potLU;
+    bool potCorrectionActive = false;
+
+    // Optional table of solution operators over the knob positions, used instead of the
+    // low-rank correction when it has been built for the current sample rate
+    KnobGrid knobGrid;
+    size_t knobGridMemoryCap = 16 * 1024 * 1024;   // in bytes, 0 disables the grid
+
+    // Impulse response of the output to the input, for ConvolutionProcessStrategy (".convolution [tolerance]"),
+    // truncated where it stays below tolerance times its peak
+    bool convolutionRequested = false;
+    double convolutionTolerance = 1e-4;
+    double maxImpulseSeconds = 10.0;
+    std::vector<float> impulseResponse;
+    double impulseOffset = 0;                   // output of the settled circuit with a silent input
+    double impulseResponseRate = 0;
+    std::vector<double> impulseResponseKnobs;   // positions of the potentiometers it was computed for
+    unsigned impulseResponseVersion = 0;
+    int impulsePartitionSize = 0;               // of the convolution, kept by value edits (see prepareProcessStrategy)
+
+    Eigen::VectorXd xPrev;  // solution before x, for the multistep integration methods
+
     std::vector<Eigen::VectorXd> channelBStates;
     std::vector<Eigen::VectorXd> channelXStates;
+    std::vector<Eigen::VectorXd> channelXPrevStates;
+
+    // Discretization of the reactive components, set with a ".method" line in the netlist.
+    // Composite methods (TR-BDF2) solve the system once per stage for each sample
+    IntegrationMethod integrationMethod = IntegrationMethod::Trapezoidal;
+    IntegrationStage integrationStages[2];
+    unsigned numIntegrationStages = 1;
 
     std::unique_ptr<ProcessStrategy> processStrategy;
+    std::unique_ptr<ProcessStrategy> standbyStrategy;   // the realtime or offline one not in use (see setOfflineRendering)
+    BlockModelBuilder blockModelBuilder;    // models of the sub-block strategy
+    std::string sourceText;                 // text the netlist was loaded from
+
+    static constexpr int numKnobs = 4;
+    double knobPositions[numKnobs] = { 0.5, 0.5, 0.5, 0.5 };
 
     unsigned m;
     unsigned n; // Number of unique nodes including the ground node (0)
 
+    unsigned maxNewtonIterations = 15;  // per integration stage, lowered by the plugin when it runs out of time
+    int maximumBlockSize = 0;           // samples per processBlock call at most, for the strategies to size their buffers
+
     bool isInitialized = false;
-    double sampleRate;
+    bool offlineRendering = false;
+    double sampleRate = 44100.0;
 
     // Constructor
-    Netlist() = default;                            // Default constructor
+    Netlist();                                      // Default constructor
     explicit Netlist(const std::string& filename);  // Constructor with filename
 
     // Public methods
     void init(const std::string& filename);
+    void initFromText(const std::string& text);
     void reset();
     void clear_system();
+    void stamp_system();
     void solve_system();
+    void solve_step();
+    void choose_solver();
+    void choose_precision();
+    void setPrecision(Precision newPrecision);
+    void choose_solve_operator();
+    void setSolveOperatorAllowed(bool allowed);
+    void factorize();
+    void solve_factorized();
+    bool precompute_knob_grid();
+    bool precompute_impulse_response();
+    bool solve_operating_point();
+
+    void update_nonlinear();
+
+    void setKnobPosition(unsigned knob, double position);
+    void setKnobGridMemoryCap(size_t bytes);
+    void updatePotentiometers();
 
     void setInputGain(float inputGain);
     void setOutputGain(float outputGain);
     void setMixPercentage(float mixPercentage);
     void setSampleRate(double sampleRate);
+    void change_sample_rate(double newSampleRate);
     void prepareChannels(int numChannels);
+    void loadChannelState(int channel);
+    void saveChannelState(int channel);
+    void setIntegrationMethod(IntegrationMethod method, double theta = 0.55);
+
+    // Binary snapshot of the solver state: x, xPrev and b of every channel, and the sources of the
+    // reactive components. It can only be restored in a netlist with the same structure
+    std::vector<char> saveState() const;
+    bool restoreState(const char* data, size_t sizeInBytes);
+    uint64_t getStructureHash() const;
+    uint64_t getContentHash() const;
+    bool hasSameTopology(const Netlist& other) const;
+    void copyStateFrom(Netlist& other);
+    void begin_stage(unsigned stage, double input);
 
     // Processing methods
     void initializeProcessStrategy();
+    std::unique_ptr<ProcessStrategy> createProcessStrategy(bool offline) const;
+    void prepareProcessStrategy(const Netlist* previous = nullptr);
     void setStrategy(std::unique_ptr<ProcessStrategy> strategy);
+    void setOfflineRendering(bool shouldRenderOffline);
     void processBlock(juce::dsp::AudioBlock<float>& audioBlock);
 
     // Generic function to get components of a specific type
@@ -86,13 +235,25 @@ public:
         }
         return specificComponents;
     }
-    float inputGain;
-    float outputGain;
-    float mixPercentage;
+    float inputGain = 0.0f;
+    float outputGain = 0.0f;
+    float mixPercentage = 100.0f;
 private:
     // Private methods
-    std::vector<std::shared_ptr<Component>> createComponentListFromTxt(const std::string& filename);
-    std::shared_ptr<Component> createComponent(const std::string& netlistLine, unsigned idx);
-    std::vector<std::string> split(const std::string& s, char delimiter);
+    std::vector<std::shared_ptr<Component>> createComponentList(const std::string& text);
+    std::shared_ptr<Component> createComponent(const NetlistLine& line, unsigned idx);
+    void addOpAmpMacromodel(const NetlistLine& line, std::vector<std::shared_ptr<Component>>& components, unsigned& idx);
+    void parseDirective(const NetlistLine& line);
+    template <typename T, typename... Args>
+    std::shared_ptr<T> makeComponent(Args&&... args);
+    void collectComponentLists();
+    void expandSubcircuit(const NetlistLine& instance, std::vector<NetlistLine>& lines, unsigned depth);
     unsigned getNodeNbr();
+    void renumberNodes();
+    std::vector<std::vector<unsigned>> getSparsityPattern() const;
+    std::vector<size_t> getInstanceKeys();
+    bool solve_dc(double gmin, double sourceScale);
+    void prepare_single();
+    void solve_single();
+    double simulate_single_error(unsigned numSamples);
 };
\ No newline at end of file
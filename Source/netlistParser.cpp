@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    netlistParser.cpp
+    Created: 20 Oct 2026 9:12:37am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "netlistParser.h"
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+
+static bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == ',' || c == '(' || c == ')';
+}
+
+
+bool parseLine(std::string_view line, NetlistLine& parsed) {
+    parsed.symbol.clear();
+    parsed.arguments.clear();
+    parsed.parameters.clear();
+
+    if (const auto comment = line.find(';'); comment != std::string_view::npos) line = line.substr(0, comment);
+
+    //tokens, '=' being a token of its own so that spaces around it don't matter
+    std::vector<std::string_view> tokens;
+    size_t i = 0;
+    while (i < line.size()) {
+        if (isSeparator(line[i])) {
+            i++;
+            continue;
+        }
+        if (line[i] == '=') {
+            tokens.push_back(line.substr(i++, 1));
+            continue;
+        }
+        const size_t start = i;
+        while (i < line.size() && !isSeparator(line[i]) && line[i] != '=') i++;
+        tokens.push_back(line.substr(start, i - start));
+    }
+
+    if (tokens.empty() || tokens[0][0] == '*') return false;
+
+    parsed.symbol = std::string(tokens[0]);
+    for (size_t k = 1; k < tokens.size(); k++) {
+        if (k + 2 < tokens.size() && tokens[k + 1] == "=") {
+            parsed.parameters.emplace_back(toLower(tokens[k]), parseValue(tokens[k + 2]));
+            k += 2;
+        }
+        else if (tokens[k] == "=") {
+            throw std::runtime_error("Misplaced '=' in: " + std::string(line));
+        }
+        else {
+            parsed.arguments.emplace_back(tokens[k]);
+        }
+    }
+    return true;
+}
+
+
+unsigned getNumTerminals(const NetlistLine& line) {
+    switch (std::toupper(static_cast<unsigned char>(line.symbol[0]))) {
+    case 'Q':
+    case 'J':
+    case 'O':
+    case 'U':
+        return 3;
+    case 'X':
+        return line.arguments.empty() ? 0 : unsigned(line.arguments.size() - 1);
+    default:
+        return 2;
+    }
+}
+
+
+double parseValue(std::string_view token) {
+    const std::string text(token);
+    char* end = nullptr;
+    const double mantissa = std::strtod(text.c_str(), &end);
+    if (end == text.c_str()) throw std::runtime_error("Invalid value: " + text);
+
+    //scale suffix, anything following it being a unit
+    const std::string suffix = toLower(end);
+    if (suffix.empty())                 return mantissa;
+    if (suffix.compare(0, 3, "meg") == 0) return mantissa * 1e6;
+    switch (suffix[0]) {
+    case 'f': return mantissa * 1e-15;
+    case 'p': return mantissa * 1e-12;
+    case 'n': return mantissa * 1e-9;
+    case 'u': return mantissa * 1e-6;
+    case 'm': return mantissa * 1e-3;
+    case 'k': return mantissa * 1e3;
+    case 'g': return mantissa * 1e9;
+    case 't': return mantissa * 1e12;
+    default:  return mantissa;
+    }
+}
+
+
+bool isValue(std::string_view token) {
+    return !token.empty() && (std::isdigit(static_cast<unsigned char>(token[0])) || token[0] == '.' || token[0] == '-' || token[0] == '+');
+}
+
+
+std::string toLower(std::string_view text) {
+    std::string lower(text);
+    for (auto& c : lower) c = char(std::tolower(static_cast<unsigned char>(c)));
+    return lower;
+}
@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    netlistParser.h
+    Created: 20 Oct 2026 9:12:37am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// One line of the netlist: its symbol, the positional arguments (nodes, value, flags or model name)
+// and the name=value parameters. Parameter names are stored in lower case
+struct NetlistLine {
+    std::string symbol;
+    std::vector<std::string> arguments;
+    std::vector<std::pair<std::string, double>> parameters;
+};
+
+// A .model card: a device type (d, npn, pnp, njf, pjf) and parameters shared by every
+// component referring to it by name
+struct ModelCard {
+    std::string type;
+    std::vector<std::pair<std::string, double>> parameters;
+};
+
+// A .subckt definition: its port names, and its lines with node names local to the definition
+struct Subcircuit {
+    std::string name;
+    std::vector<std::string> ports;
+    std::vector<NetlistLine> lines;
+};
+
+// Number of nodes at the start of the arguments of a component line (the ports of an X instance
+// being all its arguments but the last one, the subcircuit name)
+unsigned getNumTerminals(const NetlistLine& line);
+
+// Split a line on any run of spaces, tabs, commas or parentheses. Comments (a line starting
+// with '*', or anything after ';') are dropped, and "name = value" is accepted as "name=value".
+// Returns false for a line without any token
+bool parseLine(std::string_view line, NetlistLine& parsed);
+
+// Number with an optional SPICE scale suffix (f, p, n, u, m, k, meg, g, t), possibly followed by a unit: 4.7k, 100nF
+double parseValue(std::string_view token);
+bool isValue(std::string_view token);
+
+std::string toLower(std::string_view text);
@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    presetBank.cpp
+    Created: 21 Oct 2026 6:02:53pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "presetBank.h"
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+static const NetlistPreset presets[] = {
+    { "RC Low-Pass", R"(* first order low-pass, 1.6 kHz
+Vi 1 0 0
+R1 1 2 1k
+C1 2 0 100n
+Vo 2 0 0
+)" },
+
+    { "Passive Tone", R"(* P1 sets the cutoff, P2 the level
+Vi 1 0 0
+R1 1 2 1k
+P1 2 3 10k
+C1 3 0 100n
+P2 3 0 50k
+R2 2 0 22k
+Vo 3 0 0
+)" },
+
+    { "Diode Clipper", R"(* symmetric hard clipper with a 16 kHz low-pass
+Vi 1 0 0
+R1 1 2 1k
+C1 2 0 10n
+D1 2 0
+D2 0 2
+Vo 2 0 0
+)" },
+
+    { "Op-Amp Boost", R"(* inverting TL072 stage, P1 sets the gain (up to 19 dB), clipping at the rails
+* the output is divided by 11, so that the rails stay near full scale
+Vi 1 0 0
+R1 1 2 10k
+P1 2 3 100k
+R2 2 3 1meg
+U 0 2 3
+R3 3 4 10k
+R4 4 0 1k
+Vo 4 0 0
+)" },
+
+    { "Transistor Booster", R"(* common emitter 2N3904 stage on a 9 V supply
+Vi 1 0 0
+C1 1 2 1u
+R1 3 2 100k
+R2 2 0 22k
+V1 3 0 9
+R3 3 4 4.7k
+R4 5 0 1k
+Q1 4 2 5 npn
+C2 4 6 1u
+R5 6 0 100k
+Vo 6 0 0
+)" },
+};
+
+
+int getNumNetlistPresets() {
+    return int(std::size(presets));
+}
+
+
+const NetlistPreset& getNetlistPreset(int index) {
+    if (index < 0 || index >= getNumNetlistPresets()) throw std::runtime_error("Unknown preset: " + std::to_string(index));
+    return presets[index];
+}
@@ -0,0 +1,21 @@
+/*
+  ==============================================================================
+
+    presetBank.h
+    Created: 21 Oct 2026 6:02:53pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+
+// Netlists compiled into the plugin and offered as its programs, so that they load without any file
+struct NetlistPreset {
+    const char* name;
+    const char* text;
+};
+
+int getNumNetlistPresets();
+// Throws if index is out of range
+const NetlistPreset& getNetlistPreset(int index);
@@ -10,8 +10,14 @@
 
 #pragma once
 #include "component.h"
+#include "bandedSolver.h"
+#include "blockSolver.h"
 
 #include <JuceHeader.h>
+#include <Eigen/Dense>
+#include <complex>
+#include <memory>
+#include <vector>
 
 class Netlist;
 
@@ -19,6 +25,16 @@ class ProcessStrategy {
 public:
     virtual void processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) = 0;
     virtual ~ProcessStrategy() = default;
+
+    // Allocate what processBlock needs, once the netlist is solved for the rate it will run at. Called by the
+    // loaders (see Netlist::prepareProcessStrategy), so that processBlock doesn't allocate
+    virtual void prepare(Netlist& netlist) {}
+    // Take over the state kept by the strategy of the netlist being replaced (see Netlist::copyStateFrom).
+    // Called on the audio thread: doesn't allocate
+    virtual void copyStateFrom(const ProcessStrategy& other) {}
+    // Bring the state of the netlist up to date with the inputs processed, for a strategy that only updates it
+    // from time to time, before another strategy or netlist takes it over. Called on the audio thread
+    virtual void flushState(Netlist& netlist) {}
 };
 
 class LinearProcessStrategy : public ProcessStrategy {
@@ -27,7 +43,168 @@ public:
 };
 
 
+// Read-only matrices of BlockLinearProcessStrategy, for one circuit, sample rate and set of potentiometer positions.
+// Strategies processing the same circuit without potentiometers share them through SharedModelCache
+struct BlockLinearModel {
+    // Identifies the map for the current state of the netlist. Returns nullptr when the state is too large
+    static std::shared_ptr<BlockLinearModel> identify(Netlist& netlist);
+    // Identifies only the propagation of the state over sub-blocks of subBlock samples, whatever the size of the
+    // state: there is no output matrix, so the cost per sample only grows with the size over subBlock
+    static std::shared_ptr<BlockLinearModel> identifyState(Netlist& netlist, int subBlock);
+
+    bool isValidFor(const Netlist& netlist) const;
+    void readState(const Netlist& netlist, Eigen::VectorXd& state) const;
+    void writeState(Netlist& netlist, const Eigen::VectorXd& state) const;
+
+    static constexpr int maxStateSize = 64;
+
+    double sampleRate = 0;                          // conditions the map was identified in
+    std::vector<double> knobPositions;              // of the potentiometers
+
+    std::vector<unsigned> xRows, xPrevRows, bRows;  // entries of x, xPrev and b forming the state
+    int subBlock = 0;                               // samples per sub-block
+
+    Eigen::MatrixXd transition;         // state after one sample, from the state before
+    Eigen::VectorXd inputColumn;        // state after one sample, from the input
+    Eigen::VectorXd offset;             // state after one sample from a zero state and input (bias sources)
+    Eigen::RowVectorXd output;          // output probe, from the state
+    Eigen::MatrixXd blockTransition;    // transition over a sub-block
+    Eigen::MatrixXd blockInput;         // state at the end of a sub-block, from its inputs
+    Eigen::VectorXd blockOffset;
+    Eigen::MatrixXd zeroInput;          // outputs of a sub-block, from its initial state
+    Eigen::MatrixXd impulse;            // outputs of a sub-block, from its inputs (lower triangular Toeplitz)
+    Eigen::VectorXd outputOffset;
+};
+
+
+// Linear strategy solving the samples by sub-blocks. The per-sample update is an affine map of a small state
+// (the unknowns read by the reactive components and the output probe), identified by running the regular
+// solve on unit states. Over a sub-block, the output is the zero-input response of its initial state plus
+// the zero-state response, a convolution of the inputs with the impulse response. Both are computed for
+// all the sub-blocks of a block, and all the channels, with matrix-matrix products, only the state being
+// propagated sequentially from one sub-block to the next. The map is identified off the audio thread (see
+// BlockModelBuilder); while it is out of date (sample rate or potentiometer changed) and for larger states,
+// the samples are solved by the per-sample LinearProcessStrategy.
+class BlockLinearProcessStrategy : public ProcessStrategy {
+public:
+    void processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) override;
+    void prepare(Netlist& netlist) override;
+
+private:
+    LinearProcessStrategy perSample;
+
+    Eigen::VectorXd state, nextState;
+    std::vector<double> inputs, responses, stateInputs, states;    // sized by prepare, grown for larger blocks
+};
+
+
+// Linear strategy applying the impulse response computed by Netlist::precompute_impulse_response, with a uniformly
+// partitioned convolution: the first partition is applied directly, so that there is no latency, and the others
+// in the frequency domain once per partition. The cost per sample only depends on the length of the response.
+// The state of the netlist is still advanced, once per partition, with the state-only sub-block map of the
+// circuit (see BlockLinearModel::identifyState), so that the samples can be solved directly from where the
+// circuit actually is: when the response isn't valid anymore (other sample rate, potentiometer moved) they
+// are solved by BlockLinearProcessStrategy, the inputs still being recorded. The convolution only resumes once
+// the inputs it has seen since the circuit last matched the response cover the whole response, its output
+// then being that of the circuit; both changes are crossfaded over a few milliseconds. The response for new
+// knob positions is computed off the audio thread, once the knobs have settled, and installed as an edit.
+// After a value edit, the inputs kept by the channels are taken over when the partition size is the same, which
+// prepare ensures by reusing the size of the netlist being edited (see Netlist::impulsePartitionSize)
+class ConvolutionProcessStrategy : public ProcessStrategy {
+public:
+    void processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) override;
+    void prepare(Netlist& netlist) override;
+    void copyStateFrom(const ProcessStrategy& other) override;
+    void flushState(Netlist& netlist) override;
+
+private:
+    bool isValidFor(const Netlist& netlist) const;
+    float processSample(int channel, float input, bool convolve);
+    void updateTail(int channel);
+    void convolveBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock, bool advance);
+    void recordBlock(const juce::dsp::AudioBlock<float>& audioBlock, float inputGain);
+    void advanceState(Netlist& netlist, int channel);
+    void resetChannels();
+
+    struct ChannelState {
+        std::vector<float> history;                 // last partitionSize inputs, stored twice to read them contiguously
+        std::vector<float> window;                  // previous and current input partitions
+        std::vector<std::complex<float>> spectra;   // spectra of the last numPartitions - 1 windows
+        std::vector<float> tail;                    // contribution of the other partitions to the current one
+        int position = 0;                           // inputs received in the current partition
+        int newest = 0;                             // index of the newest spectrum
+        int synced = 0;                             // inputs of the current partition the state of the netlist includes
+    };
+
+    BlockLinearProcessStrategy direct;
+    std::unique_ptr<juce::dsp::FFT> fft;
+    int partitionSize = 0;
+    int numPartitions = 0;
+    int numBins = 0;
+    int responseLength = 0;
+    std::vector<float> head;                        // first partition of the response, reversed
+    std::vector<std::complex<float>> responseSpectra;   // spectra of the other partitions
+    std::vector<float> fftBuffer;
+    std::vector<std::complex<float>> accumulator;
+    std::vector<ChannelState> channels;
+    float offset = 0;                               // output of the settled circuit
+    unsigned preparedVersion = 0;
+
+    std::shared_ptr<BlockLinearModel> stateMap;     // over a partition, for the knob positions of the response
+    Eigen::VectorXd state, nextState, partitionInputs;
+    int historyLength = 0;                          // inputs seen since the circuit last matched the response (up to its length)
+    bool convolving = false;
+    int blockCapacity = 0;                          // samples per channel of scratch, larger blocks being split
+    std::vector<float> scratch;                     // the other path while crossfading
+    std::vector<float*> scratchChannels;
+};
+
+
 class NonLinearProcessStrategy : public ProcessStrategy {
 public:
     void processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) override;
 };
+
+
+// Offline strategy: the circuit is integrated with its own time step, adapted to the local truncation error
+// (estimated against a quadratic extrapolation of the previous solutions), between minStepRatio and
+// maxStepRatio times the sample period. The input is interpolated between samples, and the output
+// resampled at the sample instants. Only one-step integration methods are used (trapezoidal otherwise).
+class VariableStepProcessStrategy : public ProcessStrategy {
+public:
+    void prepare(Netlist& netlist) override;
+    void processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) override;
+
+    double relativeTolerance = 1e-3;
+    double absoluteTolerance = 1e-6;
+    double minStepRatio = 1.0 / 64.0;
+    double maxStepRatio = 4.0;
+
+private:
+    struct ChannelState {
+        Eigen::VectorXd points[3];      // last accepted solutions, oldest first
+        double times[3] = { 0, 0, 0 };  // their times, in samples from the start of the current block
+        double outputs[3] = { 0, 0, 0 };
+        int numPoints = 0;
+        double step = 1.0;              // next step, in samples
+        float lastInput = 0;
+    };
+
+    void solve(Netlist& netlist, const IntegrationStage& stage, double step, double input);
+    void factorize(Netlist& netlist);
+    void solveFactorized(Netlist& netlist);
+
+    // Copy of the solver the netlist chose, factorized for the steps, so that the factorization the fixed step
+    // strategies solve with is still there when rendering goes back to realtime
+    enum class Solver { DenseLU, Blocks, Banded };
+    Solver solver = Solver::DenseLU;
+    Eigen::PartialPivLU<Eigen::MatrixXd> luDecomp;
+    BlockSolver blockSolver;
+    BandedSolver bandedSolver;
+
+    std::vector<ChannelState> channels;
+    std::vector<float> inputs;
+    double factorizedStep = 0;          // step A was last factorized for, in samples
+    double factorizedRate = 0;
+    std::vector<double> knobPositions;  // positions A was last factorized for
+};
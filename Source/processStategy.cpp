@@ -9,34 +9,30 @@
 */
 #include "processStartegy.h"
 #include "netlist.h"
+#include "modelCache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 // Ensure all needed component classes are fully available either through direct includes or through Netlist.h
 
 void LinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) {
     const auto mix = netlist.mixPercentage / 100.0f;
 
+    netlist.updatePotentiometers();
+
     for (auto channel = 0; channel < audioBlock.getNumChannels(); ++channel) {
         auto* channelSamples = audioBlock.getChannelPointer(channel);
 
-        netlist.b = netlist.channelBStates[channel];
-        netlist.x = netlist.channelXStates[channel];
+        netlist.loadChannelState(channel);
 
         for (auto i = 0; i < audioBlock.getNumSamples(); i++) {
             const auto inputSample = channelSamples[i];
             const auto inputCircuitSample = inputSample * std::pow(10, netlist.inputGain / 20);
 
-            for (auto& source : netlist.voltageSources) {
-                auto externalSource = std::dynamic_pointer_cast<ExternalVoltageSource>(source);
-                if (externalSource) {
-                    externalSource->update(inputCircuitSample);
-                }
-                source->stamp(netlist);
-            }
-            for (auto& comp : netlist.reactiveComponents) {
-                comp->updateVoltage(netlist);
-                comp->stamp(netlist);
+            for (unsigned stage = 0; stage < netlist.numIntegrationStages; stage++) {
+                netlist.begin_stage(stage, inputCircuitSample);
+                netlist.solve_step();
             }
-
-            netlist.x.tail(netlist.x.size() - 1) = netlist.luDecomp.solve(netlist.b.tail(netlist.b.size() - 1));
             for (auto& voltageProbe : netlist.voltageProbes) {
                 voltageProbe->getVoltage(netlist);
             }
@@ -46,8 +42,617 @@ void LinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock
             channelSamples[i] = outputSample * mix + (1 - mix) * inputSample;
         }
 
-        netlist.channelBStates[channel] = netlist.b;
-        netlist.channelXStates[channel] = netlist.x;
+        netlist.saveChannelState(channel);
+    }
+}
+
+
+// One sample with the regular solve, as in LinearProcessStrategy
+static void stepSample(Netlist& netlist, double input) {
+    for (unsigned stage = 0; stage < netlist.numIntegrationStages; stage++) {
+        netlist.begin_stage(stage, input);
+        netlist.solve_step();
+    }
+}
+
+
+// Rows of the state and its per-sample map (transition, inputColumn, offset), identified by running the regular
+// solve on unit states, for the current sample rate and knob positions
+static std::shared_ptr<BlockLinearModel> identifyStep(Netlist& netlist, int maxSize) {
+    auto model = std::make_shared<BlockLinearModel>();
+    auto& xRows = model->xRows;
+
+    //unknowns read at the start of a sample: by the reactive components, by the output probe,
+    //and the previous input for the methods whose first stage interpolates it
+    const unsigned n = netlist.n;
+    std::vector<bool> isRow(netlist.x.size(), false);
+    for (const auto& comp : netlist.reactiveComponents) {
+        isRow[comp->start_node] = isRow[comp->end_node] = isRow[n + comp->index] = true;
+    }
+    const auto& probe = netlist.voltageProbes[0];
+    isRow[probe->start_node] = isRow[probe->end_node] = true;
+    for (unsigned k = 1; k < isRow.size(); k++) {
+        if (isRow[k]) xRows.push_back(k);
+    }
+    if (netlist.integrationStages[0].a2 != 0.0) model->xPrevRows = xRows;
+    if (netlist.integrationStages[0].timeFraction != 1.0) {
+        for (const auto& source : netlist.voltageSources) {
+            if (dynamic_cast<ExternalVoltageSource*>(source.get()) != nullptr) model->bRows.push_back(n + source->index);
+        }
+    }
+
+    const int size = int(xRows.size() + model->xPrevRows.size() + model->bRows.size());
+    if (size > maxSize) return nullptr;
+
+    model->sampleRate = netlist.sampleRate;
+    for (const auto& pot : netlist.potentiometers) model->knobPositions.push_back(netlist.knobPositions[pot->knob]);
+
+    //columns of the map, from the response to a zero state and input, to the input, and to each unit state
+    const Eigen::VectorXd savedX = netlist.x, savedXPrev = netlist.xPrev, savedB = netlist.b;
+    Eigen::VectorXd unit = Eigen::VectorXd::Zero(size), next(size);
+
+    model->writeState(netlist, unit);
+    stepSample(netlist, 0.0);
+    model->readState(netlist, model->offset);
+
+    model->writeState(netlist, unit);
+    stepSample(netlist, 1.0);
+    model->readState(netlist, next);
+    model->inputColumn = next - model->offset;
+
+    auto& transition = model->transition;
+    transition.resize(size, size);
+    for (int k = 0; k < size; k++) {
+        unit.setZero();
+        unit(k) = 1.0;
+        model->writeState(netlist, unit);
+        stepSample(netlist, 0.0);
+        model->readState(netlist, next);
+        transition.col(k) = next - model->offset;
+    }
+
+    netlist.x = savedX;
+    netlist.xPrev = savedXPrev;
+    netlist.b = savedB;
+    return model;
+}
+
+
+// Identify the per-sample map of the state and precompute the sub-block matrices, for the current
+// sample rate and knob positions
+std::shared_ptr<BlockLinearModel> BlockLinearModel::identify(Netlist& netlist) {
+    auto model = identifyStep(netlist, maxStateSize);
+    if (model == nullptr) return nullptr;
+
+    const auto& xRows = model->xRows;
+    const auto& probe = netlist.voltageProbes[0];
+    const int size = int(model->transition.rows());
+    const auto& transition = model->transition;
+
+    auto& output = model->output;
+    output = Eigen::RowVectorXd::Zero(size);
+    for (unsigned k = 0; k < xRows.size(); k++) {
+        if (xRows[k] == probe->start_node) output(k) += 1.0;
+        if (xRows[k] == probe->end_node) output(k) -= 1.0;
+    }
+
+    //the output of sample j of a sub-block is output * state(j + 1), with
+    //state(j + 1) = transition^(j+1) * state(0) + sum over i <= j of transition^(j-i) * (inputColumn * input(i) + offset)
+    const int subBlock = model->subBlock = std::clamp(size, 16, 64);
+    model->zeroInput.resize(subBlock, size);
+    model->impulse = Eigen::MatrixXd::Zero(subBlock, subBlock);
+    model->outputOffset.resize(subBlock);
+    model->blockInput.resize(size, subBlock);
+    model->blockOffset = Eigen::VectorXd::Zero(size);
+
+    Eigen::MatrixXd power = Eigen::MatrixXd::Identity(size, size);   // transition^j
+    double accumulatedOffset = 0;
+    for (int j = 0; j < subBlock; j++) {
+        const Eigen::RowVectorXd outputPower = output * power;
+        const double response = outputPower.dot(model->inputColumn);
+        for (int i = j; i < subBlock; i++) model->impulse(i, i - j) = response;
+
+        accumulatedOffset += outputPower.dot(model->offset);
+        model->outputOffset(j) = accumulatedOffset;
+        model->blockOffset.noalias() += power * model->offset;
+        model->blockInput.col(subBlock - 1 - j).noalias() = power * model->inputColumn;
+
+        power = power * transition;
+        model->zeroInput.row(j).noalias() = output * power;
+    }
+    model->blockTransition = power;
+    return model;
+}
+
+
+// State-only sub-block map: blockInput and blockOffset from the powers of the transition applied to
+// the input column and the offset, and the transition over the sub-block by repeated squaring
+std::shared_ptr<BlockLinearModel> BlockLinearModel::identifyState(Netlist& netlist, int subBlock) {
+    auto model = identifyStep(netlist, std::numeric_limits<int>::max());
+    const int size = int(model->transition.rows());
+    model->subBlock = subBlock;
+
+    model->blockInput.resize(size, subBlock);
+    model->blockInput.col(subBlock - 1) = model->inputColumn;
+    for (int j = subBlock - 2; j >= 0; j--) model->blockInput.col(j).noalias() = model->transition * model->blockInput.col(j + 1);
+
+    Eigen::VectorXd term = model->offset;
+    model->blockOffset = term;
+    for (int j = 1; j < subBlock; j++) {
+        term = model->transition * term;
+        model->blockOffset += term;
+    }
+
+    Eigen::MatrixXd square = model->transition;
+    model->blockTransition = Eigen::MatrixXd::Identity(size, size);
+    for (int remaining = subBlock; remaining > 0; remaining >>= 1) {
+        if (remaining & 1) model->blockTransition = model->blockTransition * square;
+        if (remaining > 1) square = square * square;
+    }
+    return model;
+}
+
+
+bool BlockLinearModel::isValidFor(const Netlist& netlist) const {
+    if (sampleRate != netlist.sampleRate) return false;
+    for (size_t j = 0; j < knobPositions.size(); j++) {
+        if (knobPositions[j] != netlist.knobPositions[netlist.potentiometers[j]->knob]) return false;
+    }
+    return true;
+}
+
+
+void BlockLinearModel::readState(const Netlist& netlist, Eigen::VectorXd& target) const {
+    target.resize(xRows.size() + xPrevRows.size() + bRows.size());
+    Eigen::Index k = 0;
+    for (auto row : xRows)     target(k++) = netlist.x(row);
+    for (auto row : xPrevRows) target(k++) = netlist.xPrev(row);
+    for (auto row : bRows)     target(k++) = netlist.b(row);
+}
+
+
+void BlockLinearModel::writeState(Netlist& netlist, const Eigen::VectorXd& source) const {
+    Eigen::Index k = 0;
+    for (auto row : xRows)     netlist.x(row) = source(k++);
+    for (auto row : xPrevRows) netlist.xPrev(row) = source(k++);
+    for (auto row : bRows)     netlist.b(row) = source(k++);
+}
+
+
+void BlockLinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) {
+    netlist.updatePotentiometers();
+
+    //the matrices depend on the sample rate and on the positions of the knobs driving a potentiometer
+    const auto* model = netlist.voltageProbes.empty() ? nullptr : netlist.blockModelBuilder.acquire(netlist);
+    if (model == nullptr) {
+        perSample.processBlock(netlist, audioBlock);
+        return;
+    }
+
+    const auto& map = *model;
+    const auto mix = netlist.mixPercentage / 100.0f;
+    const double inputGain = std::pow(10, netlist.inputGain / 20);
+    const float outputGain = std::pow(10.0f, netlist.outputGain / 20.0f);
+    const int numChannels = int(audioBlock.getNumChannels());
+    const int numSamples = int(audioBlock.getNumSamples());
+    const int size = int(map.transition.rows());
+    const int subBlock = map.subBlock;
+    const int numSubBlocks = numSamples / subBlock;
+    const int numColumns = numSubBlocks * numChannels;     // the sub-blocks of each channel, one after the other
+
+    //the buffers only grow, so that the block products don't allocate once the largest block has been seen
+    inputs.resize(std::max(inputs.size(), size_t(subBlock) * numColumns));
+    responses.resize(inputs.size());
+    stateInputs.resize(std::max(stateInputs.size(), size_t(size) * numColumns));
+    states.resize(stateInputs.size());
+    Eigen::Map<Eigen::MatrixXd> blockInputs(inputs.data(), subBlock, numColumns);
+    Eigen::Map<Eigen::MatrixXd> blockResponses(responses.data(), subBlock, numColumns);
+    Eigen::Map<Eigen::MatrixXd> blockStateInputs(stateInputs.data(), size, numColumns);
+    Eigen::Map<Eigen::MatrixXd> blockStates(states.data(), size, numColumns);
+
+    //zero-state responses of all the sub-blocks of all the channels, and their contributions to the state
+    for (int channel = 0; channel < numChannels; ++channel) {
+        const auto* channelSamples = audioBlock.getChannelPointer(channel);
+        double* channelInputs = inputs.data() + size_t(subBlock) * numSubBlocks * channel;
+        for (int i = 0; i < subBlock * numSubBlocks; i++) channelInputs[i] = channelSamples[i] * inputGain;
+    }
+    blockResponses.noalias() = map.impulse.triangularView<Eigen::Lower>() * blockInputs;
+    blockStateInputs.noalias() = map.blockInput * blockInputs;
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        auto* channelSamples = audioBlock.getChannelPointer(channel);
+
+        netlist.loadChannelState(channel);
+        map.readState(netlist, state);
+
+        //the state at the start of each sub-block
+        for (int q = channel * numSubBlocks; q < (channel + 1) * numSubBlocks; q++) {
+            blockStates.col(q) = state;
+            state.noalias() = map.blockTransition * blockStates.col(q);
+            state += blockStateInputs.col(q) + map.blockOffset;
+        }
+
+        //samples left after the last whole sub-block
+        for (int i = subBlock * numSubBlocks; i < numSamples; i++) {
+            const auto inputSample = channelSamples[i];
+            nextState.noalias() = map.transition * state;
+            state = nextState + map.inputColumn * (inputSample * inputGain) + map.offset;
+            const float outputSample = float(map.output.dot(state)) * outputGain;
+            channelSamples[i] = outputSample * mix + (1 - mix) * inputSample;
+        }
+
+        map.writeState(netlist, state);
+        for (auto& voltageProbe : netlist.voltageProbes) {
+            voltageProbe->getVoltage(netlist);
+        }
+        netlist.saveChannelState(channel);
+    }
+
+    //zero-input responses, from the states at the start of the sub-blocks
+    blockResponses.noalias() += map.zeroInput * blockStates;
+    blockResponses.colwise() += map.outputOffset;
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        auto* channelSamples = audioBlock.getChannelPointer(channel);
+        const double* channelResponses = responses.data() + size_t(subBlock) * numSubBlocks * channel;
+        for (int i = 0; i < subBlock * numSubBlocks; i++) {
+            const auto inputSample = channelSamples[i];
+            const float outputSample = float(channelResponses[i]) * outputGain;
+            channelSamples[i] = outputSample * mix + (1 - mix) * inputSample;
+        }
+    }
+}
+
+
+// Size the buffers for the largest block and the channels of the netlist, with the state size of its model
+void BlockLinearProcessStrategy::prepare(Netlist& netlist) {
+    const auto* model = netlist.voltageProbes.empty() ? nullptr : netlist.blockModelBuilder.acquire(netlist);
+    if (model == nullptr) return;
+
+    const int size = int(model->transition.rows());
+    const size_t numSamples = size_t(std::max(netlist.maximumBlockSize, 0)) * std::max<size_t>(netlist.channelXStates.size(), 1);
+    state.resize(size);
+    nextState.resize(size);
+    inputs.resize(std::max(inputs.size(), numSamples));
+    responses.resize(inputs.size());
+    stateInputs.resize(std::max(stateInputs.size(), size_t(size) * (numSamples / size_t(model->subBlock))));
+    states.resize(stateInputs.size());
+}
+
+
+bool ConvolutionProcessStrategy::isValidFor(const Netlist& netlist) const {
+    if (netlist.impulseResponse.empty() || netlist.impulseResponseRate != netlist.sampleRate) return false;
+    if (stateMap == nullptr || !stateMap->isValidFor(netlist)) return false;
+    for (size_t j = 0; j < netlist.potentiometers.size(); j++) {
+        if (netlist.impulseResponseKnobs[j] != netlist.knobPositions[netlist.potentiometers[j]->knob]) return false;
+    }
+    return true;
+}
+
+
+// Split the response in partitions of about the square root of its length, which balances
+// the direct first partition against the frequency-domain products of the others
+void ConvolutionProcessStrategy::prepare(Netlist& netlist) {
+    direct.prepare(netlist);
+    channels.clear();
+    stateMap = nullptr;
+    if (netlist.impulseResponse.empty() || netlist.impulseResponseRate != netlist.sampleRate) return;
+
+    const auto& response = netlist.impulseResponse;
+    const int length = int(response.size());
+    const int numChannels = int(std::max<size_t>(netlist.channelXStates.size(), 1));
+
+    //an edited netlist keeps the partitions of the one it replaces, whose state it takes over
+    int order = 5;
+    if (netlist.impulsePartitionSize > 0) {
+        while ((1 << order) < netlist.impulsePartitionSize) order++;
+    }
+    else {
+        while (order < 10 && (1 << order) * (1 << order) < length) order++;
+    }
+    partitionSize = 1 << order;
+    netlist.impulsePartitionSize = partitionSize;
+    numPartitions = (length + partitionSize - 1) / partitionSize;
+    numBins = partitionSize + 1;
+    responseLength = length;
+    fft = std::make_unique<juce::dsp::FFT>(order + 1);
+    fftBuffer.assign(4 * partitionSize, 0.0f);
+    accumulator.assign(numBins, {});
+
+    //at the knob positions of the response, which it was computed just before with
+    netlist.updatePotentiometers();
+    stateMap = BlockLinearModel::identifyState(netlist, partitionSize);
+    const int size = int(stateMap->transition.rows());
+    state.resize(size);
+    nextState.resize(size);
+    partitionInputs.resize(partitionSize);
+
+    head.assign(partitionSize, 0.0f);
+    for (int k = 0; k < std::min(length, partitionSize); k++) head[partitionSize - 1 - k] = response[k];
+
+    //spectra of the partitions zero-padded to twice their size, for the overlap-save products
+    responseSpectra.assign(size_t(std::max(numPartitions - 1, 0)) * numBins, {});
+    for (int p = 1; p < numPartitions; p++) {
+        std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+        const int end = std::min(length, (p + 1) * partitionSize);
+        std::copy(response.begin() + p * partitionSize, response.begin() + end, fftBuffer.begin());
+        fft->performRealOnlyForwardTransform(fftBuffer.data(), true);
+        const auto* bins = reinterpret_cast<const std::complex<float>*>(fftBuffer.data());
+        std::copy(bins, bins + numBins, responseSpectra.begin() + size_t(p - 1) * numBins);
+    }
+
+    channels.assign(numChannels, {});
+    for (auto& channel : channels) {
+        channel.history.assign(2 * partitionSize, 0.0f);
+        channel.window.assign(2 * partitionSize, 0.0f);
+        channel.spectra.assign(responseSpectra.size(), {});
+        channel.tail.assign(partitionSize, 0.0f);
+    }
+    offset = float(netlist.impulseOffset);
+    preparedVersion = netlist.impulseResponseVersion;
+
+    blockCapacity = std::max(netlist.maximumBlockSize, partitionSize);
+    scratch.assign(size_t(blockCapacity) * numChannels, 0.0f);
+    scratchChannels.resize(numChannels);
+    for (int channel = 0; channel < numChannels; channel++) scratchChannels[channel] = scratch.data() + size_t(blockCapacity) * channel;
+
+    //the circuit starts settled, which the silent history matches
+    historyLength = responseLength;
+    convolving = true;
+}
+
+
+void ConvolutionProcessStrategy::resetChannels() {
+    for (auto& channel : channels) {
+        std::fill(channel.history.begin(), channel.history.end(), 0.0f);
+        std::fill(channel.window.begin(), channel.window.end(), 0.0f);
+        std::fill(channel.spectra.begin(), channel.spectra.end(), std::complex<float>());
+        std::fill(channel.tail.begin(), channel.tail.end(), 0.0f);
+        channel.position = channel.newest = channel.synced = 0;
+    }
+}
+
+
+// The inputs of each channel, and the spectra of the previous partitions newest first, as far as both responses
+// reach. The samples are then solved directly from the state of the netlist taken over, until the inputs seen
+// with the new response cover it, except when the response is the same (a new strategy choice)
+void ConvolutionProcessStrategy::copyStateFrom(const ProcessStrategy& other) {
+    convolving = false;
+    historyLength = 0;
+
+    const auto* previous = dynamic_cast<const ConvolutionProcessStrategy*>(&other);
+    if (previous == nullptr || partitionSize == 0 || previous->partitionSize != partitionSize) {
+        resetChannels();
+        return;
+    }
+
+    const int numSpectra = numPartitions - 1;
+    const int previousSpectra = previous->numPartitions - 1;
+    const size_t numChannels = std::min(channels.size(), previous->channels.size());
+    for (size_t channel = 0; channel < numChannels; channel++) {
+        auto& target = channels[channel];
+        const auto& from = previous->channels[channel];
+        std::copy(from.history.begin(), from.history.end(), target.history.begin());
+        std::copy(from.window.begin(), from.window.end(), target.window.begin());
+        std::copy(from.tail.begin(), from.tail.end(), target.tail.begin());
+        target.position = from.position;
+        target.synced = from.synced;
+
+        std::fill(target.spectra.begin(), target.spectra.end(), std::complex<float>());
+        target.newest = 0;
+        for (int p = 0; p < std::min(numSpectra, previousSpectra); p++) {
+            const auto* source = from.spectra.data() + size_t((from.newest - p + previousSpectra) % previousSpectra) * numBins;
+            std::copy(source, source + numBins, target.spectra.begin() + size_t((numSpectra - p) % numSpectra) * numBins);
+        }
+    }
+
+    if (previous->head == head && previous->responseSpectra == responseSpectra && previous->offset == offset) {
+        historyLength = previous->historyLength;
+        convolving = previous->convolving;
+    }
+}
+
+
+// Step the state of each channel over the inputs of the current partition it doesn't include yet
+void ConvolutionProcessStrategy::flushState(Netlist& netlist) {
+    if (stateMap == nullptr) return;
+
+    const auto& map = *stateMap;
+    for (int channel = 0; channel < int(channels.size()); channel++) {
+        auto& current = channels[channel];
+        if (current.synced == current.position) continue;
+
+        netlist.loadChannelState(channel);
+        map.readState(netlist, state);
+        for (int k = current.synced; k < current.position; k++) {
+            nextState.noalias() = map.transition * state;
+            state = nextState + map.inputColumn * double(current.window[partitionSize + k]) + map.offset;
+        }
+        map.writeState(netlist, state);
+        netlist.saveChannelState(channel);
+        current.synced = current.position;
+    }
+}
+
+
+// Step the state of a channel to the end of the partition just completed, whose inputs are now
+// the first half of its window: in one sub-block when the state was at its start
+void ConvolutionProcessStrategy::advanceState(Netlist& netlist, int channel) {
+    auto& current = channels[channel];
+    const auto& map = *stateMap;
+    netlist.loadChannelState(channel);
+    map.readState(netlist, state);
+
+    if (current.synced == 0) {
+        for (int k = 0; k < partitionSize; k++) partitionInputs(k) = current.window[k];
+        nextState.noalias() = map.blockTransition * state;
+        nextState.noalias() += map.blockInput * partitionInputs;
+        state = nextState + map.blockOffset;
+    }
+    else {
+        for (int k = current.synced; k < partitionSize; k++) {
+            nextState.noalias() = map.transition * state;
+            state = nextState + map.inputColumn * double(current.window[k]) + map.offset;
+        }
+    }
+
+    map.writeState(netlist, state);
+    for (auto& voltageProbe : netlist.voltageProbes) {
+        voltageProbe->getVoltage(netlist);
+    }
+    netlist.saveChannelState(channel);
+    current.synced = 0;
+}
+
+
+// Record an input, and when convolve is set return the output of the convolution for it
+float ConvolutionProcessStrategy::processSample(int channel, float input, bool convolve) {
+    auto& current = channels[channel];
+    const int position = current.position;
+
+    //first partition, directly on the last inputs
+    current.history[position] = current.history[position + partitionSize] = input;
+    current.window[partitionSize + position] = input;
+    float output = 0;
+    if (convolve) {
+        const float* window = current.history.data() + position + 1;
+        output = offset + current.tail[position];
+        for (int k = 0; k < partitionSize; k++) output += head[k] * window[k];
+    }
+
+    if (++current.position < partitionSize) return output;
+    current.position = 0;
+
+    //once per partition: spectrum of the last two partitions of inputs, then (only needed while convolving)
+    //the contribution of the other partitions of the response to the next partition of outputs
+    if (numPartitions > 1) {
+        const int numSpectra = numPartitions - 1;
+        current.newest = (current.newest + 1) % numSpectra;
+        std::copy(current.window.begin(), current.window.end(), fftBuffer.begin());
+        std::fill(fftBuffer.begin() + 2 * partitionSize, fftBuffer.end(), 0.0f);
+        fft->performRealOnlyForwardTransform(fftBuffer.data(), true);
+        const auto* bins = reinterpret_cast<const std::complex<float>*>(fftBuffer.data());
+        std::copy(bins, bins + numBins, current.spectra.begin() + size_t(current.newest) * numBins);
+        if (convolve) updateTail(channel);
+    }
+    std::copy(current.window.begin() + partitionSize, current.window.end(), current.window.begin());
+    return output;
+}
+
+
+// Contribution of the partitions of the response after the first, from the spectra of the previous
+// windows, to the outputs of the current partition
+void ConvolutionProcessStrategy::updateTail(int channel) {
+    auto& current = channels[channel];
+    const int numSpectra = numPartitions - 1;
+    if (numSpectra == 0) return;
+
+    std::fill(accumulator.begin(), accumulator.end(), std::complex<float>());
+    for (int p = 0; p < numSpectra; p++) {
+        const int slot = (current.newest - p + numSpectra) % numSpectra;
+        const auto* x = current.spectra.data() + size_t(slot) * numBins;
+        const auto* h = responseSpectra.data() + size_t(p) * numBins;
+        for (int bin = 0; bin < numBins; bin++) accumulator[bin] += x[bin] * h[bin];
+    }
+
+    std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+    std::copy(accumulator.begin(), accumulator.end(), reinterpret_cast<std::complex<float>*>(fftBuffer.data()));
+    fft->performRealOnlyInverseTransform(fftBuffer.data());
+    std::copy(fftBuffer.begin() + partitionSize, fftBuffer.begin() + 2 * partitionSize, current.tail.begin());
+}
+
+
+// Convolve a block, advancing the state of the netlist at the end of each partition when it follows the convolution
+void ConvolutionProcessStrategy::convolveBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock, bool advance) {
+    const auto mix = netlist.mixPercentage / 100.0f;
+    const float inputGain = std::pow(10.0f, netlist.inputGain / 20.0f);
+    const float outputGain = std::pow(10.0f, netlist.outputGain / 20.0f);
+
+    for (int channel = 0; channel < int(audioBlock.getNumChannels()); ++channel) {
+        auto* channelSamples = audioBlock.getChannelPointer(channel);
+
+        for (int i = 0; i < int(audioBlock.getNumSamples()); i++) {
+            const auto inputSample = channelSamples[i];
+            const float outputSample = processSample(channel, inputSample * inputGain, true) * outputGain;
+            channelSamples[i] = outputSample * mix + (1 - mix) * inputSample;
+            if (advance && channels[channel].position == 0) advanceState(netlist, channel);
+        }
+    }
+}
+
+
+// Record the inputs of a block solved directly, which advances the state of the netlist over all of them
+void ConvolutionProcessStrategy::recordBlock(const juce::dsp::AudioBlock<float>& audioBlock, float inputGain) {
+    for (int channel = 0; channel < int(audioBlock.getNumChannels()); ++channel) {
+        const auto* channelSamples = audioBlock.getChannelPointer(channel);
+        for (int i = 0; i < int(audioBlock.getNumSamples()); i++) processSample(channel, channelSamples[i] * inputGain, false);
+        channels[channel].synced = channels[channel].position;
+    }
+}
+
+
+void ConvolutionProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) {
+    const int numChannels = int(audioBlock.getNumChannels());
+    const int numSamples = int(audioBlock.getNumSamples());
+
+    //prepared by the loader, for the response and the channels the netlist has
+    if (preparedVersion != netlist.impulseResponseVersion || channels.size() < size_t(numChannels) || stateMap == nullptr) {
+        direct.processBlock(netlist, audioBlock);
+        return;
+    }
+    //the scratch buffer holds a block of the largest size the host announced
+    if (numSamples > blockCapacity) {
+        for (int start = 0; start < numSamples; start += blockCapacity) {
+            auto subBlock = audioBlock.getSubBlock(size_t(start), size_t(std::min(blockCapacity, numSamples - start)));
+            processBlock(netlist, subBlock);
+        }
+        return;
+    }
+
+    //the inputs recorded before the circuit last matched the response don't count
+    if (!isValidFor(netlist)) historyLength = 0;
+    const bool shouldConvolve = historyLength >= responseLength;
+    historyLength = std::min(historyLength + numSamples, responseLength);
+    const float inputGain = std::pow(10.0f, netlist.inputGain / 20.0f);
+
+    if (shouldConvolve == convolving) {
+        if (convolving) {
+            convolveBlock(netlist, audioBlock, true);
+        }
+        else {
+            recordBlock(audioBlock, inputGain);
+            direct.processBlock(netlist, audioBlock);
+        }
+        return;
+    }
+
+    //the path left processes a copy of the block, from which the output is crossfaded; the state of the
+    //netlist follows the direct solve over the whole block
+    juce::dsp::AudioBlock<float> other(scratchChannels.data(), size_t(numChannels), size_t(numSamples));
+    for (int channel = 0; channel < numChannels; ++channel) {
+        std::copy(audioBlock.getChannelPointer(channel), audioBlock.getChannelPointer(channel) + numSamples, scratchChannels[channel]);
+    }
+    if (convolving) {
+        flushState(netlist);
+        direct.processBlock(netlist, audioBlock);
+        convolveBlock(netlist, other, false);
+    }
+    else {
+        direct.processBlock(netlist, other);
+        for (int channel = 0; channel < numChannels; ++channel) updateTail(channel);
+        convolveBlock(netlist, audioBlock, false);
+    }
+    for (auto& channel : channels) channel.synced = channel.position;
+    convolving = shouldConvolve;
+
+    const int transitionSamples = std::min(numSamples, int(0.005 * netlist.sampleRate) + 1);
+    for (int channel = 0; channel < numChannels; ++channel) {
+        auto* samples = audioBlock.getChannelPointer(channel);
+        const auto* previousSamples = scratchChannels[channel];
+        for (int i = 0; i < transitionSamples; ++i) {
+            const float ratio = float(i + 1) / float(transitionSamples);
+            samples[i] = (1.0f - ratio) * previousSamples[i] + ratio * samples[i];
+        }
     }
 }
 
@@ -55,58 +660,50 @@ void LinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock
 void NonLinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) {
     const auto mix = netlist.mixPercentage / 100.0f;
 
+    //the system is restamped at each Newton iteration, so the potentiometers just need their new values
+    for (auto& pot : netlist.potentiometers) {
+        pot->setPosition(netlist.knobPositions[pot->knob]);
+    }
+
     for (auto channel = 0; channel < audioBlock.getNumChannels(); ++channel) {
         auto* channelSamples = audioBlock.getChannelPointer(channel);
 
-        netlist.b = netlist.channelBStates[channel];
-        netlist.x = netlist.channelXStates[channel];
+        netlist.loadChannelState(channel);
 
         for (auto i = 0; i < audioBlock.getNumSamples(); i++) {
             const auto inputSample = channelSamples[i];
             const auto inputCircuitSample = inputSample * std::pow(10, netlist.inputGain / 20);
 
-            for (auto& source : netlist.voltageSources) {
-                auto externalSource = std::dynamic_pointer_cast<ExternalVoltageSource>(source);
-                if (externalSource) {
-                    externalSource->update(inputCircuitSample);
-                }
-                source->stamp(netlist);
-            }
+            for (unsigned stage = 0; stage < netlist.numIntegrationStages; stage++) {
+                netlist.begin_stage(stage, inputCircuitSample);
 
-            for (auto& comp : netlist.reactiveComponents) {
-                comp->updateVoltage(netlist);
-            }
-            //Newton-Raphson method
-            for (unsigned k = 1; k < 16; k++) {
-                /*
-                Have to improve the way to update the values of the diodes,
-                since re - stamping the whole system at each iteration is not efficient.
-                In theory, we should just stamp the new values of the diodes (Ieq and Geq) in the A matrix and b vector.
-                Here, we are oblige to reset all the system, since the stamping operation
-                is done by a "+=" operation, and we can't just remove the contribution of the diodes
-                in the A matrix and b vector
-                */
-
-                netlist.A.setZero();
-                netlist.b.setZero();
-
-                for (auto& diode : netlist.diodes) {
-                    diode->update_voltage(netlist);
-                    diode->update_Id(netlist);
-                    diode->update_Geq(netlist);
-                    diode->update_Ieq(netlist);
-                }
+                //Newton-Raphson method
+                for (unsigned k = 0; k < netlist.maxNewtonIterations; k++) {
+                    /*
+                    Have to improve the way to update the values of the diodes,
+                    since re - stamping the whole system at each iteration is not efficient.
+                    In theory, we should just stamp the new values of the diodes (Ieq and Geq) in the A matrix and b vector.
+                    Here, we are oblige to reset all the system, since the stamping operation
+                    is done by a "+=" operation, and we can't just remove the contribution of the diodes
+                    in the A matrix and b vector
+                    */
 
-                for (auto& comp : netlist.components) {
-                    comp->stamp(netlist);
-                }
-                Eigen::VectorXd x_old = netlist.x;
+                    netlist.A.setZero();
+                    netlist.b.setZero();
 
-                netlist.luDecomp.compute(netlist.A.bottomRightCorner(netlist.A.rows() - 1, netlist.A.cols() - 1));
-                netlist.x.tail(netlist.x.size() - 1) = netlist.luDecomp.solve(netlist.b.tail(netlist.b.size() - 1));
+                    netlist.update_nonlinear();
 
-                if ((x_old.tail(x_old.size() - 1) - netlist.x.tail(netlist.x.size() - 1)).norm() < 1e-6) {
-                    break;
+                    for (auto& comp : netlist.components) {
+                        comp->stamp(netlist);
+                    }
+                    Eigen::VectorXd x_old = netlist.x;
+
+                    netlist.factorize();
+                    netlist.solve_factorized();
+
+                    if ((x_old.tail(x_old.size() - 1) - netlist.x.tail(netlist.x.size() - 1)).norm() < 1e-6) {
+                        break;
+                    }
                 }
             }
 
@@ -119,7 +716,226 @@ void NonLinearProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBl
             channelSamples[i] = outputSample * mix + (1 - mix) * inputSample;
         }
 
-        netlist.channelBStates[channel] = netlist.b;
-        netlist.channelXStates[channel] = netlist.x;
+        netlist.saveChannelState(channel);
     }
-}   
\ No newline at end of file
+}   
+
+void VariableStepProcessStrategy::prepare(Netlist& netlist) {
+    solver = netlist.solverMode == Netlist::SolverMode::Blocks ? Solver::Blocks
+           : netlist.solverMode == Netlist::SolverMode::Banded ? Solver::Banded : Solver::DenseLU;
+    if (solver == Solver::Blocks) blockSolver = netlist.blockSolver;
+    if (solver == Solver::Banded) bandedSolver = netlist.bandedSolver;
+    luDecomp = Eigen::PartialPivLU<Eigen::MatrixXd>(netlist.A.rows() - 1);
+    factorizedStep = 0;
+
+    channels.resize(std::max<size_t>(netlist.channelXStates.size(), 1));
+    inputs.resize(size_t(std::max(netlist.maximumBlockSize, 0)));
+}
+
+
+void VariableStepProcessStrategy::factorize(Netlist& netlist) {
+    const auto reducedA = netlist.A.bottomRightCorner(netlist.A.rows() - 1, netlist.A.cols() - 1);
+
+    switch (solver) {
+    case Solver::Blocks:
+        blockSolver.factorize(reducedA);
+        break;
+    case Solver::Banded:
+        if (bandedSolver.factorize(reducedA)) break;
+        solver = Solver::DenseLU;
+        [[fallthrough]];
+    default:
+        luDecomp.compute(reducedA);
+    }
+}
+
+
+void VariableStepProcessStrategy::solveFactorized(Netlist& netlist) {
+    const auto rhs = netlist.b.tail(netlist.b.size() - 1);
+    auto solution = netlist.x.tail(netlist.x.size() - 1);
+
+    switch (solver) {
+    case Solver::Blocks:
+        blockSolver.solve(rhs, solution);
+        break;
+    case Solver::Banded:
+        bandedSolver.solve(rhs, solution);
+        break;
+    default:
+        solution = luDecomp.solve(rhs);
+    }
+}
+
+
+// Solve one step of the given length (in samples), for the input at its end
+void VariableStepProcessStrategy::solve(Netlist& netlist, const IntegrationStage& stage, double step, double input) {
+    const bool stepChanged = step != factorizedStep;
+    if (stepChanged) {
+        for (auto& comp : netlist.reactiveComponents) comp->setResistance(step / netlist.sampleRate, stage);
+    }
+
+    for (auto& source : netlist.voltageSources) {
+        if (auto* externalSource = dynamic_cast<ExternalVoltageSource*>(source.get())) {
+            externalSource->update(input);
+        }
+    }
+    for (auto& comp : netlist.reactiveComponents) {
+        comp->updateVoltage(netlist, stage);
+    }
+    netlist.xPrev = netlist.x;
+
+    if (netlist.nonlinearComponents.empty()) {
+        //linear circuits are only refactorized when the step changes
+        if (stepChanged) {
+            netlist.A.setZero();
+            netlist.b.setZero();
+            for (auto& comp : netlist.components) comp->stamp(netlist);
+            factorize(netlist);
+            factorizedStep = step;
+        }
+        else {
+            for (auto& source : netlist.voltageSources) source->stamp(netlist);
+            for (auto& comp : netlist.reactiveComponents) comp->stamp(netlist);
+        }
+        solveFactorized(netlist);
+        return;
+    }
+
+    //Newton-Raphson method, as in NonLinearProcessStrategy
+    factorizedStep = step;
+    for (unsigned k = 1; k < 16; k++) {
+        netlist.A.setZero();
+        netlist.b.setZero();
+
+        netlist.update_nonlinear();
+        for (auto& comp : netlist.components) {
+            comp->stamp(netlist);
+        }
+        Eigen::VectorXd x_old = netlist.x;
+
+        factorize(netlist);
+        solveFactorized(netlist);
+
+        if ((x_old.tail(x_old.size() - 1) - netlist.x.tail(netlist.x.size() - 1)).norm() < 1e-6) {
+            break;
+        }
+    }
+}
+
+
+void VariableStepProcessStrategy::processBlock(Netlist& netlist, juce::dsp::AudioBlock<float>& audioBlock) {
+    const auto mix = netlist.mixPercentage / 100.0f;
+    const auto inputGain = std::pow(10.0, netlist.inputGain / 20.0);
+    const auto outputGain = std::pow(10.0f, netlist.outputGain / 20.0f);
+    const int numSamples = int(audioBlock.getNumSamples());
+
+    const IntegrationStage trapezoidal = { 0.5, 0.5, 1.0, 0.0, 1.0 };
+    const auto& stage = netlist.numIntegrationStages == 1 && netlist.integrationStages[0].a2 == 0.0
+        ? netlist.integrationStages[0] : trapezoidal;
+
+    //a knob move or a new sample rate changes A, so it has to be refactorized
+    if (factorizedRate != netlist.sampleRate) {
+        factorizedRate = netlist.sampleRate;
+        factorizedStep = 0;
+    }
+    for (auto& pot : netlist.potentiometers) {
+        pot->setPosition(netlist.knobPositions[pot->knob]);
+    }
+    if (knobPositions.size() != Netlist::numKnobs || !std::equal(knobPositions.begin(), knobPositions.end(), netlist.knobPositions)) {
+        knobPositions.assign(netlist.knobPositions, netlist.knobPositions + Netlist::numKnobs);
+        factorizedStep = 0;
+    }
+
+    channels.resize(audioBlock.getNumChannels());
+    inputs.resize(numSamples);
+
+    for (auto channel = 0; channel < audioBlock.getNumChannels(); ++channel) {
+        auto* channelSamples = audioBlock.getChannelPointer(channel);
+        auto& state = channels[channel];
+        std::copy(channelSamples, channelSamples + numSamples, inputs.begin());
+
+        netlist.loadChannelState(channel);
+
+        //the input is linear between two samples, the last sample of the previous block being at time -1
+        auto inputAt = [&](double time) {
+            const int i = int(std::floor(time));
+            const double previous = i < 0 ? state.lastInput : inputs[i];
+            const double next = inputs[std::min(i + 1, numSamples - 1)];
+            return inputGain * (previous + (time - i) * (next - previous));
+        };
+
+        if (state.numPoints == 0) {
+            state.points[2] = netlist.x;
+            state.times[2] = -1.0;
+            state.outputs[2] = 0.0;
+            state.numPoints = 1;
+        }
+
+        int nextOutput = 0;
+        while (nextOutput < numSamples) {
+            const double time = state.times[2];
+            const double step = std::min(state.step, numSamples - 1 - time);
+
+            const Eigen::VectorXd savedX = netlist.x, savedXPrev = netlist.xPrev, savedB = netlist.b;
+            solve(netlist, stage, step, inputAt(time + step));
+
+            //local truncation error, against the extrapolation of the previous accepted solutions
+            double error = 0;
+            if (state.numPoints >= 3) {
+                const double t0 = state.times[0], t1 = state.times[1], t2 = state.times[2], t = time + step;
+                const double l0 = (t - t1) * (t - t2) / ((t0 - t1) * (t0 - t2));
+                const double l1 = (t - t0) * (t - t2) / ((t1 - t0) * (t1 - t2));
+                const double l2 = (t - t0) * (t - t1) / ((t2 - t0) * (t2 - t1));
+                for (Eigen::Index j = 1; j < netlist.x.size(); j++) {
+                    const double predicted = l0 * state.points[0](j) + l1 * state.points[1](j) + l2 * state.points[2](j);
+                    const double tolerance = absoluteTolerance + relativeTolerance * std::abs(netlist.x(j));
+                    error = std::max(error, std::abs(netlist.x(j) - predicted) / tolerance);
+                }
+            }
+
+            const double minStep = minStepRatio;
+            if (error > 1.0 && step > minStep) {
+                netlist.x = savedX;
+                netlist.xPrev = savedXPrev;
+                netlist.b = savedB;
+                state.step = std::max(minStep, step * std::max(0.25, 0.9 * std::cbrt(1.0 / error)));
+                continue;
+            }
+
+            netlist.voltageProbes[0]->getVoltage(netlist);
+            for (int k = 0; k < 2; k++) {
+                state.points[k] = state.points[k + 1];
+                state.times[k] = state.times[k + 1];
+                state.outputs[k] = state.outputs[k + 1];
+            }
+            state.points[2] = netlist.x;
+            state.times[2] = time + step;
+            state.outputs[2] = netlist.voltageProbes[0]->value;
+            state.numPoints = std::min(state.numPoints + 1, 3);
+
+            //resample the output at the sample instants covered by this step
+            while (nextOutput < numSamples && nextOutput <= state.times[2]) {
+                const double t = nextOutput;
+                const double t1 = state.times[1], t2 = state.times[2];
+                double output = state.outputs[1] + (t - t1) / (t2 - t1) * (state.outputs[2] - state.outputs[1]);
+                if (state.numPoints >= 3) {
+                    const double t0 = state.times[0];
+                    output = state.outputs[0] * (t - t1) * (t - t2) / ((t0 - t1) * (t0 - t2))
+                           + state.outputs[1] * (t - t0) * (t - t2) / ((t1 - t0) * (t1 - t2))
+                           + state.outputs[2] * (t - t0) * (t - t1) / ((t2 - t0) * (t2 - t1));
+                }
+                channelSamples[nextOutput] = float(output) * outputGain * mix + (1 - mix) * inputs[nextOutput];
+                nextOutput++;
+            }
+
+            const double growth = error > 0 ? 0.9 * std::cbrt(1.0 / error) : 2.0;
+            state.step = std::clamp(step * std::clamp(growth, 0.25, 2.0), minStep, maxStepRatio);
+        }
+
+        //the times are counted from the start of the next block
+        for (auto& t : state.times) t -= numSamples;
+        state.lastInput = inputs[numSamples - 1];
+
+        netlist.saveChannelState(channel);
+    }
+}
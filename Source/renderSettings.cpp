@@ -0,0 +1,30 @@
+/*
+  ==============================================================================
+
+    renderSettings.cpp
+    Created: 20 Oct 2026 3:26:10pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "renderSettings.h"
+#include <stdexcept>
+
+
+std::unique_ptr<Netlist> RenderSettings::createNetlist(const std::string& netlistText, int numChannels) const {
+    auto netlist = std::make_unique<Netlist>();
+    for (unsigned knob = 0; knob < unsigned(Netlist::numKnobs); knob++) netlist->setKnobPosition(knob, knobPositions[knob]);
+    netlist->initFromText(netlistText);
+    if (!netlist->isInitialized) throw std::runtime_error("Unable to load the netlist");
+
+    netlist->prepareChannels(numChannels);
+    netlist->setSampleRate(sampleRate);
+    netlist->solve_operating_point();
+    netlist->setInputGain(inputGain);
+    netlist->setOutputGain(outputGain);
+    netlist->setMixPercentage(mixPercentage);
+    netlist->solve_system();
+    netlist->prepareProcessStrategy();
+    return netlist;
+}
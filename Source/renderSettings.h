@@ -0,0 +1,24 @@
+/*
+  ==============================================================================
+
+    renderSettings.h
+    Created: 20 Oct 2026 3:26:10pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "netlist.h"
+#include <string>
+
+// Settings of the offline renderings (StreamingRenderer, ChunkedRenderer, and the runs of StrategySelector), and
+// the netlist they load with them
+struct RenderSettings {
+    double sampleRate = 48000;
+    float inputGain = 0, outputGain = 0, mixPercentage = 100;
+    double knobPositions[Netlist::numKnobs] = { 0.5, 0.5, 0.5, 0.5 };
+
+    // Throws if the netlist can't be loaded
+    std::unique_ptr<Netlist> createNetlist(const std::string& netlistText, int numChannels) const;
+};
@@ -0,0 +1,216 @@
+/*
+  ==============================================================================
+
+    strategySelector.cpp
+    Created: 21 Oct 2026 9:48:15am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "strategySelector.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+
+void StrategyChoice::apply(Netlist& netlist) const {
+    netlist.linearStrategy = linearStrategy;
+    netlist.solverOverridden = solverOverridden;
+    netlist.solverOverride = solver;
+    netlist.setSolveOperatorAllowed(useOperator);
+    if (!useKnobGrid) netlist.setKnobGridMemoryCap(0);
+    netlist.initializeProcessStrategy();
+}
+
+
+std::string StrategyChoice::getDescription() const {
+    std::string description = linearStrategy == Netlist::LinearStrategy::PerSample ? "per-sample"
+                            : linearStrategy == Netlist::LinearStrategy::Block ? "sub-blocks" : "convolution";
+    if (solverOverridden) {
+        description += solver == Netlist::SolverMode::Blocks ? ", blocks" : solver == Netlist::SolverMode::Banded ? ", banded" : ", dense LU";
+    }
+    if (useOperator) description += ", operator";
+    if (useKnobGrid) description += ", knob grid";
+    return description;
+}
+
+
+bool StrategyChoice::operator==(const StrategyChoice& other) const {
+    return linearStrategy == other.linearStrategy && solverOverridden == other.solverOverridden && solver == other.solver
+        && useOperator == other.useOperator && useKnobGrid == other.useKnobGrid;
+}
+
+
+StrategySelector::StrategySelector(const std::string& netlistText)
+    : netlistText(netlistText) {}
+
+
+std::unique_ptr<Netlist> StrategySelector::createNetlist(const StrategyChoice& choice) const {
+    auto netlist = std::make_unique<Netlist>();
+    for (unsigned knob = 0; knob < unsigned(Netlist::numKnobs); knob++) netlist->setKnobPosition(knob, settings.knobPositions[knob]);
+    netlist->initFromText(netlistText);
+    if (!netlist->isInitialized) throw std::runtime_error("Unable to load the netlist");
+
+    choice.apply(*netlist);
+    netlist->prepareChannels(1);
+    netlist->setSampleRate(settings.sampleRate);
+    netlist->solve_operating_point();
+    netlist->setInputGain(settings.inputGain);
+    netlist->setOutputGain(settings.outputGain);
+    netlist->setMixPercentage(100);
+    netlist->solve_system();
+    netlist->precompute_knob_grid();
+    if (choice.linearStrategy == Netlist::LinearStrategy::Convolution) netlist->precompute_impulse_response();
+    netlist->maximumBlockSize = blockSize;
+    netlist->prepareProcessStrategy();
+    return netlist;
+}
+
+
+// Process the synthetic input, block by block, at the knob positions of the settings or with the knobs moving
+// slowly around them. With numSamples at 0, runs for benchmarkSeconds (at most maxSamples) and sets numSamples.
+// Returns the time per sample, the first block (where the strategies build their tables) being left out
+double StrategySelector::run(Netlist& netlist, std::vector<float>& output, int& numSamples, bool moveKnobs) const {
+    const bool timed = numSamples == 0;
+    const int length = timed ? maxSamples : numSamples;
+    output.resize(length);
+
+    uint32_t noise = 22222;
+    for (int i = 0; i < length; i++) {
+        noise = noise * 1664525u + 1013904223u;
+        const double t = i / settings.sampleRate;
+        output[i] = float(0.4 * std::sin(2 * juce::MathConstants<double>::pi * 110 * t)
+                        + 0.2 * std::sin(2 * juce::MathConstants<double>::pi * 1830 * t)
+                        + 0.1 * (double(noise >> 8) / double(1 << 24) - 0.5));
+    }
+
+    double seconds = 0;
+    int timedSamples = 0;
+    int position = 0;
+    for (int block = 0; position < length; block++) {
+        const int count = std::min(blockSize, length - position);
+        for (unsigned knob = 0; moveKnobs && knob < unsigned(Netlist::numKnobs); knob++) {
+            const double sweep = 0.05 * std::sin(0.1 * block + knob);
+            netlist.setKnobPosition(knob, std::clamp(settings.knobPositions[knob] + sweep, 0.0, 1.0));
+        }
+
+        float* channel = output.data() + position;
+        juce::dsp::AudioBlock<float> audioBlock(&channel, 1, size_t(count));
+        const auto start = std::chrono::steady_clock::now();
+        netlist.processBlock(audioBlock);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (block > 0 || position + count == length) {
+            seconds += elapsed;
+            timedSamples += count;
+        }
+        position += count;
+        if (timed && seconds >= benchmarkSeconds) break;
+    }
+
+    numSamples = position;
+    output.resize(position);
+    return seconds / std::max(timedSamples, 1);
+}
+
+
+std::vector<StrategyChoice> StrategySelector::getCandidates(const Netlist& netlist) const {
+    std::vector<Netlist::SolverMode> solvers = { Netlist::SolverMode::DenseLU, Netlist::SolverMode::Banded };
+    if (netlist.blockSolver.isActive()) solvers.push_back(Netlist::SolverMode::Blocks);
+
+    std::vector<StrategyChoice> candidates;
+    const bool linear = netlist.nonlinearComponents.empty();
+    const std::vector<bool> knobGrid = linear && !netlist.potentiometers.empty() ? std::vector<bool>{ false, true } : std::vector<bool>{ false };
+
+    for (const bool useKnobGrid : knobGrid) {
+        StrategyChoice choice;
+        choice.useKnobGrid = useKnobGrid;
+        choice.solverOverridden = true;
+        choice.linearStrategy = Netlist::LinearStrategy::PerSample;
+
+        //the solver only matters to the per-sample solves; the other strategies just build from them
+        for (const auto solver : solvers) {
+            choice.solver = solver;
+            choice.useOperator = false;
+            candidates.push_back(choice);
+            if (linear) {
+                choice.useOperator = true;
+                candidates.push_back(choice);
+            }
+        }
+        if (!linear) continue;
+
+        choice.solverOverridden = false;
+        choice.useOperator = true;
+        choice.linearStrategy = Netlist::LinearStrategy::Block;
+        candidates.push_back(choice);
+        if (netlist.convolutionRequested) {
+            choice.linearStrategy = Netlist::LinearStrategy::Convolution;
+            candidates.push_back(choice);
+        }
+    }
+    return candidates;
+}
+
+
+// Run a candidate at fixed knobs, and with potentiometers again with the knobs moving, each on a new netlist.
+// The first candidate measured (the reference) sets numSamples and the reference outputs
+StrategySelector::Result StrategySelector::measure(const StrategyChoice& choice, bool hasKnobs, int& numSamples) {
+    const bool isReference = numSamples == 0;
+    Result result;
+    result.choice = choice;
+
+    auto fixed = createNetlist(choice);
+    result.secondsPerSample = run(*fixed, isReference ? referenceOutput : output, numSamples, false);
+    result.cost = result.secondsPerSample;
+    if (!isReference) {
+        float peak = 1e-12f;
+        for (const auto sample : referenceOutput) peak = std::max(peak, std::abs(sample));
+        for (int i = 0; i < numSamples; i++) {
+            result.error = std::max(result.error, double(std::abs(output[i] - referenceOutput[i]) / peak));
+        }
+    }
+    if (!hasKnobs) return result;
+
+    auto moving = createNetlist(choice);
+    int movingSamples = numSamples;
+    result.secondsPerKnobMoveSample = run(*moving, isReference ? referenceKnobMoveOutput : output, movingSamples, true);
+    result.cost = (1 - knobMoveShare) * result.secondsPerSample + knobMoveShare * result.secondsPerKnobMoveSample;
+    if (!isReference) {
+        float peak = 1e-12f;
+        for (const auto sample : referenceKnobMoveOutput) peak = std::max(peak, std::abs(sample));
+        for (int i = 0; i < movingSamples; i++) {
+            result.error = std::max(result.error, double(std::abs(output[i] - referenceKnobMoveOutput[i]) / peak));
+        }
+    }
+    return result;
+}
+
+
+StrategyChoice StrategySelector::select() {
+    results.clear();
+
+    StrategyChoice reference;
+    reference.linearStrategy = Netlist::LinearStrategy::PerSample;
+    reference.solverOverridden = true;
+    reference.solver = Netlist::SolverMode::DenseLU;
+    reference.useOperator = false;
+    reference.useKnobGrid = false;
+
+    auto netlist = createNetlist(reference);
+    const bool hasKnobs = !netlist->potentiometers.empty();
+    int numSamples = 0;
+    results.push_back(measure(reference, hasKnobs, numSamples));
+
+    Result best = results.front();
+    for (const auto& choice : getCandidates(*netlist)) {
+        if (choice == reference) continue;
+
+        const auto result = measure(choice, hasKnobs, numSamples);
+        results.push_back(result);
+        if (result.error <= tolerance && result.cost < best.cost) best = result;
+    }
+    return best.choice;
+}
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    strategySelector.h
+    Created: 21 Oct 2026 9:48:15am
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "renderSettings.h"
+#include <string>
+#include <vector>
+
+// One way of processing a netlist: the strategy for linear circuits, the solver of the (Newton) solves,
+// and whether the explicit solution operator and the knob grid may be used
+struct StrategyChoice {
+    Netlist::LinearStrategy linearStrategy = Netlist::LinearStrategy::Block;
+    bool solverOverridden = false;
+    Netlist::SolverMode solver = Netlist::SolverMode::DenseLU;
+    bool useOperator = true;
+    bool useKnobGrid = true;
+
+    // Configures a netlist loaded with init, before its system is solved
+    void apply(Netlist& netlist) const;
+    std::string getDescription() const;
+    bool operator==(const StrategyChoice& other) const;
+};
+
+
+// Picks the fastest way of processing a netlist by running each candidate on its own copy of the netlist,
+// with a synthetic input (sines and noise) for a few milliseconds. The knobs stay where they are set, since
+// that is how the circuit is processed most of the time; with potentiometers, the same input is then run again
+// with the knobs moving at every block, timed separately and weighted by knobMoveShare. The candidates
+// combine the linear strategies (per-sample, sub-blocks, convolution when the netlist asks for it), the solvers
+// (dense LU, banded, blocks) and, with potentiometers, the knob grid against the low-rank updates.
+// A candidate is only kept if its output stays within tolerance of the per-sample dense LU solve.
+// Loads the netlist (from its text) once per candidate, so it is meant to run on a background thread
+class StrategySelector {
+public:
+    explicit StrategySelector(const std::string& netlistText);
+
+    // Throws if the netlist can't be loaded
+    StrategyChoice select();
+
+    struct Result {
+        StrategyChoice choice;
+        double secondsPerSample = 0;
+        double error = 0;                   // largest output difference, relative to the peak of the reference
+        double secondsPerKnobMoveSample = 0;    // with the knobs moving, for netlists with potentiometers
+        double cost = 0;                    // weighted time per sample the selection compares
+    };
+    std::vector<Result> results;    // of the last selection, the reference first
+
+    RenderSettings settings;
+    int blockSize = 256;
+    int maxSamples = 16384;
+    double benchmarkSeconds = 0.005;    // the reference runs until this much time has been spent, in whole blocks
+    double tolerance = 1e-3;
+    double knobMoveShare = 0.1;         // of the processing time assumed to be spent with the knobs moving
+
+private:
+    std::vector<StrategyChoice> getCandidates(const Netlist& netlist) const;
+    std::unique_ptr<Netlist> createNetlist(const StrategyChoice& choice) const;
+    double run(Netlist& netlist, std::vector<float>& output, int& numSamples, bool moveKnobs) const;
+    Result measure(const StrategyChoice& choice, bool hasKnobs, int& numSamples);
+
+    std::vector<float> referenceOutput, referenceKnobMoveOutput, output;
+
+    std::string netlistText;
+};
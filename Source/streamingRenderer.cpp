@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    streamingRenderer.cpp
+    Created: 20 Oct 2026 5:41:52pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#include "streamingRenderer.h"
+#include <stdexcept>
+#include <thread>
+
+
+StreamingRenderer::StreamingRenderer(const std::string& netlistText)
+    : netlistText(netlistText) {}
+
+
+// Slot to fill, or -1 if the consumer has stopped
+int StreamingRenderer::waitToWrite(BlockQueue& queue) {
+    int start1, size1, start2, size2;
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    for (;;) {
+        if (queue.aborted) return -1;
+        queue.fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 > 0) return start1;
+        queue.changed.wait(lock);
+    }
+}
+
+// Slot to consume, or -1 once the producer has finished and the queue is empty
+int StreamingRenderer::waitToRead(BlockQueue& queue) {
+    int start1, size1, start2, size2;
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    for (;;) {
+        const bool finished = queue.finished;
+        queue.fifo.prepareToRead(1, start1, size1, start2, size2);
+        if (size1 > 0) return start1;
+        if (finished) return -1;
+        queue.changed.wait(lock);
+    }
+}
+
+// Wake the stage waiting on the queue after a block was moved, or the queue finished or aborted. Taking the
+// mutex once the change is made means a stage which found nothing to do is already waiting when notified
+void StreamingRenderer::signal(BlockQueue& queue) {
+    { std::lock_guard<std::mutex> lock(queue.mutex); }
+    queue.changed.notify_all();
+}
+
+
+bool StreamingRenderer::render(const juce::File& inputFile, const juce::File& outputFile) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    //memory-mapped reading when the format supports it (wav, aiff), buffered reading otherwise
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    if (auto* format = formatManager.findFormatForFileExtension(inputFile.getFileExtension())) {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader(format->createMemoryMappedReader(inputFile));
+        if (mappedReader != nullptr && mappedReader->mapEntireFile()) reader = std::move(mappedReader);
+    }
+    if (reader == nullptr) reader.reset(formatManager.createReaderFor(inputFile));
+    if (reader == nullptr) throw std::runtime_error("Unable to read " + inputFile.getFullPathName().toStdString());
+
+    const int numChannels = int(reader->numChannels);
+    const auto numSamples = reader->lengthInSamples;
+
+    auto* outputFormat = formatManager.findFormatForFileExtension(outputFile.getFileExtension());
+    if (outputFormat == nullptr) outputFormat = formatManager.findFormatForFileExtension("wav");
+    outputFile.deleteFile();
+    auto outputStream = outputFile.createOutputStream();
+    if (outputStream == nullptr) throw std::runtime_error("Unable to write " + outputFile.getFullPathName().toStdString());
+    std::unique_ptr<juce::AudioFormatWriter> writer(outputFormat->createWriterFor(outputStream.get(), reader->sampleRate,
+        unsigned(numChannels), outputBitsPerSample, {}, 0));
+    if (writer == nullptr) throw std::runtime_error("Unsupported output format for " + outputFile.getFullPathName().toStdString());
+    outputStream.release();     //owned by the writer from now on
+
+    settings.sampleRate = reader->sampleRate;
+    auto netlist = settings.createNetlist(netlistText, numChannels);
+
+    BlockQueue decoded(queueDepth), solved(queueDepth);
+    for (auto* queue : { &decoded, &solved }) {
+        for (auto& buffer : queue->buffers) buffer.setSize(numChannels, blockSize);
+    }
+
+    std::thread readerThread([&]() {
+        for (juce::int64 position = 0; position < numSamples; position += blockSize) {
+            const int slot = waitToWrite(decoded);
+            if (slot < 0) break;
+            const int length = int(std::min<juce::int64>(blockSize, numSamples - position));
+            reader->read(&decoded.buffers[size_t(slot)], 0, length, position, true, true);
+            decoded.lengths[size_t(slot)] = length;
+            decoded.fifo.finishedWrite(1);
+            signal(decoded);
+        }
+        decoded.finished = true;
+        signal(decoded);
+    });
+
+    std::atomic<bool> writeFailed{ false };
+    std::thread writerThread([&]() {
+        for (int slot; (slot = waitToRead(solved)) >= 0;) {
+            if (!writer->writeFromAudioSampleBuffer(solved.buffers[size_t(slot)], 0, solved.lengths[size_t(slot)])) {
+                writeFailed = true;
+                solved.aborted = true;
+                signal(solved);
+                break;
+            }
+            solved.fifo.finishedRead(1);
+            signal(solved);
+        }
+    });
+
+    //solve stage: the solved block is swapped into the output queue, and the block it had is recycled for reading
+    bool stopped = false;
+    for (int slot; (slot = waitToRead(decoded)) >= 0;) {
+        if (shouldStop != nullptr && *shouldStop) {
+            stopped = true;
+            decoded.aborted = true;
+            signal(decoded);
+            break;
+        }
+        auto& buffer = decoded.buffers[size_t(slot)];
+        const int length = decoded.lengths[size_t(slot)];
+        juce::dsp::AudioBlock<float> block(buffer.getArrayOfWritePointers(), size_t(numChannels), 0, size_t(length));
+        netlist->processBlock(block);
+
+        const int outputSlot = waitToWrite(solved);
+        if (outputSlot < 0) {
+            decoded.aborted = true;
+            signal(decoded);
+            break;
+        }
+        std::swap(buffer, solved.buffers[size_t(outputSlot)]);
+        solved.lengths[size_t(outputSlot)] = length;
+        solved.fifo.finishedWrite(1);
+        signal(solved);
+        decoded.fifo.finishedRead(1);
+        signal(decoded);
+    }
+    solved.finished = true;
+    signal(solved);
+
+    readerThread.join();
+    writerThread.join();
+    writer.reset();     //flushes and closes the file
+
+    if (writeFailed) throw std::runtime_error("Error while writing " + outputFile.getFullPathName().toStdString());
+    if (stopped) outputFile.deleteFile();
+    return !stopped;
+}
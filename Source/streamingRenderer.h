@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    streamingRenderer.h
+    Created: 20 Oct 2026 5:41:52pm
+    Author:  eliot
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "renderSettings.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Headless rendering of an audio file through a netlist (see the processor's renderFile), as a three stage
+// pipeline: the reader thread decodes blocks (from a memory-mapped file when the format allows it), the calling
+// thread solves them with Netlist::processBlock, and the writer thread encodes them. The stages are connected by
+// single producer / single consumer queues of preallocated blocks, so reading and writing overlap with the solve.
+// A stage waiting for a block or a free slot sleeps on the condition variable of the queue, woken by the other
+// stage when it moves a block
+class StreamingRenderer {
+public:
+    explicit StreamingRenderer(const std::string& netlistText);
+
+    // Throws if the input can't be read, the output can't be written or the netlist can't be loaded.
+    // The sample rate of the settings is replaced by the one of the input file. Returns false, without
+    // leaving an output file, if shouldStop was set before the end
+    bool render(const juce::File& inputFile, const juce::File& outputFile);
+
+    RenderSettings settings;
+    int blockSize = 8192;
+    int queueDepth = 4;             // blocks in flight between two stages
+    int outputBitsPerSample = 24;
+    const std::atomic<bool>* shouldStop = nullptr;  // checked between blocks
+
+private:
+    // Ring of blocks between two stages. The buffers are swapped between queues rather than copied
+    struct BlockQueue {
+        explicit BlockQueue(int depth) : fifo(depth + 1), buffers(size_t(depth + 1)), lengths(size_t(depth + 1), 0) {}
+
+        juce::AbstractFifo fifo;
+        std::vector<juce::AudioBuffer<float>> buffers;
+        std::vector<int> lengths;
+        std::atomic<bool> finished{ false };    // set by the producer after its last block
+        std::atomic<bool> aborted{ false };     // set by the consumer when it stops early
+        std::mutex mutex;                       // only orders the waits against the signals
+        std::condition_variable changed;
+    };
+
+    static int waitToWrite(BlockQueue& queue);
+    static int waitToRead(BlockQueue& queue);
+    static void signal(BlockQueue& queue);
+
+    std::string netlistText;
+};